@@ -0,0 +1,501 @@
+#include "mem.h"
+#include "hint.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Bancs d'essai de l'allocateur
+ * Usage : bench [nom du banc...] (tous les bancs par défaut)
+ * Le Makefile construit bench avec le format d'en-tête par défaut et bench_compact avec -DMEM_COMPACT.
+ * Le banc hint rejoue la trace enregistrée dans le journal BENCH_TRACE (LIBMALLOC_LOG de libmalloc.so) s'il est donné,
+ * une trace synthétique sinon.
+ */
+
+#define BENCH_MEMORY_SIZE (1L << 20)
+
+#ifdef MEM_COMPACT
+#define LAYOUT "compact"
+#else
+#define LAYOUT "complet"
+#endif
+
+static char *memory;
+
+// Retourne une date en nanosecondes.
+static double now_ns() {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+// Générateur pseudo-aléatoire reproductible (xorshift), pour que tous les formats rejouent la même suite d'opérations.
+static unsigned long random_state;
+
+static unsigned long next_random() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+// Nombre de zones de size octets que l'on peut allouer dans une zone neuve gérée par engine.
+static size_t capacity(enum mem_engine engine, size_t size) {
+    size_t count = 0;
+
+    mem_init_engine(memory, BENCH_MEMORY_SIZE, engine);
+    while (mem_alloc(size) != NULL)
+        count++;
+    return count;
+}
+
+/* Nombre de zones d'une même taille que l'on peut allouer dans la zone, et surcoût des métadonnées par zone,
+ * pour la liste de blocs libres et pour les tables de bits (arrondi aux granules de 16 octets compris).
+ */
+static void bench_capacity() {
+    static const size_t sizes[] = { 1, 4, 8, 12, 16, 20, 24, 28, 32, 60, 64, 124, 128 };
+
+    printf("[%s] capacite d'une zone de %ld octets (liste / tables de bits) :\n", LAYOUT, BENCH_MEMORY_SIZE);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t list = capacity(MEM_ENGINE_LIST, sizes[i]), bitmap = capacity(MEM_ENGINE_BITMAP, sizes[i]);
+
+        printf("  %4zu octets : %7zu zones, %5.2f octets de surcout par zone / %7zu zones, %5.2f octets\n",
+               sizes[i], list, (double) BENCH_MEMORY_SIZE / list - sizes[i],
+               bitmap, (double) BENCH_MEMORY_SIZE / bitmap - sizes[i]);
+    }
+}
+
+/* Débit d'une suite aléatoire d'allocations et de libérations de petites zones (8 à 128 octets),
+ * avec au plus LIVE zones vivantes à la fois.
+ */
+#define LIVE 1024
+#define OPERATIONS 1000000
+
+static void bench_throughput() {
+    static void *live[LIVE];
+    size_t failures = 0;
+
+    mem_init(memory, BENCH_MEMORY_SIZE);
+    memset(live, 0, sizeof(live));
+    random_state = 88172645463325252UL;
+
+    double start = now_ns();
+    for (long i = 0; i < OPERATIONS; i++) {
+        size_t slot = next_random() % LIVE;
+
+        if (live[slot] != NULL) {
+            mem_free(live[slot]);
+            live[slot] = NULL;
+        } else if ((live[slot] = mem_alloc(8 + next_random() % 121)) == NULL) {
+            failures++;
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    printf("[%s] debit : %.1f ns par operation (%zu echecs)\n", LAYOUT, elapsed / OPERATIONS, failures);
+}
+
+/* Fragmentation causée par des tampons de tailles puissances de 2 (32 octets à 4 Kio), alloués et libérés aléatoirement :
+ * pour chaque stratégie de la liste de blocs libres et pour le système de compagnons, on mesure le nombre d'échecs
+ * et la fragmentation externe moyenne, 1 - (plus grand bloc libre / total libre), relevée régulièrement.
+ * Pour les compagnons, les blocs de la décomposition initiale de la zone ne fusionnent jamais, ce qui gonfle cette mesure :
+ * le nombre d'échecs est alors plus parlant.
+ */
+#define FRAG_SLOTS 1536
+#define FRAG_OPERATIONS 200000
+#define FRAG_SAMPLE 1000
+
+static size_t free_total, free_largest, free_blocks;
+
+static void collect_free(void *adr, size_t size, int free) {
+    if (!free)
+        return;
+    free_total += size;
+    free_blocks++;
+    if (size > free_largest)
+        free_largest = size;
+}
+
+static void bench_fragmentation() {
+    static const struct {
+        const char *name;
+        enum mem_engine engine;
+        mem_fit_function_t *fit;
+    } allocators[] = {
+        { "first", MEM_ENGINE_LIST, mem_fit_first },
+        { "best", MEM_ENGINE_LIST, mem_fit_best },
+        { "worst", MEM_ENGINE_LIST, mem_fit_worst },
+        { "buddy", MEM_ENGINE_BUDDY, NULL },
+        { "bitmap", MEM_ENGINE_BITMAP, NULL },
+    };
+    static void *live[FRAG_SLOTS];
+
+    printf("[%s] fragmentation (tampons de 2^5 a 2^12 octets) :\n", LAYOUT);
+    for (size_t a = 0; a < sizeof(allocators) / sizeof(allocators[0]); a++) {
+        size_t failures = 0, samples = 0;
+        double fragmentation = 0;
+
+        mem_init_engine(memory, BENCH_MEMORY_SIZE, allocators[a].engine);
+        if (allocators[a].fit != NULL)
+            mem_fit(allocators[a].fit);
+        memset(live, 0, sizeof(live));
+        random_state = 88172645463325252UL;
+
+        double start = now_ns();
+        for (long i = 0; i < FRAG_OPERATIONS; i++) {
+            size_t slot = next_random() % FRAG_SLOTS;
+
+            if (live[slot] != NULL) {
+                mem_free(live[slot]);
+                live[slot] = NULL;
+            } else if ((live[slot] = mem_alloc((size_t) 32 << (next_random() % 8))) == NULL) {
+                failures++;
+            }
+
+            if (i % FRAG_SAMPLE == 0) {
+                free_total = free_largest = free_blocks = 0;
+                mem_show(collect_free);
+                if (free_total != 0) {
+                    fragmentation += 1 - (double) free_largest / free_total;
+                    samples++;
+                }
+            }
+        }
+        double elapsed = now_ns() - start;
+
+        free_total = free_largest = free_blocks = 0;
+        mem_show(collect_free);
+        printf("  %-6s : fragmentation moyenne %5.1f %%, %6zu echecs, %5zu blocs libres a la fin, %.2f s\n",
+               allocators[a].name, samples ? 100 * fragmentation / samples : 0, failures, free_blocks, elapsed / 1e9);
+    }
+}
+
+/* Durée d'un parcours complet par mem_show() d'une zone fragmentée : on remplit la zone de petites zones de tailles
+ * aléatoires et on en libère une sur deux. La liste de blocs libres lit l'en-tête de chaque bloc dans la zone,
+ * le moteur à tables de bits ne lit que ses tables.
+ */
+#define SHOW_ROUNDS 200
+
+static size_t shown_blocks;
+
+static void count_block(void *adr, size_t size, int free) {
+    shown_blocks++;
+}
+
+static void bench_show() {
+    static const struct {
+        const char *name;
+        enum mem_engine engine;
+    } engines[] = {
+        { "list", MEM_ENGINE_LIST },
+        { "bitmap", MEM_ENGINE_BITMAP },
+    };
+
+    printf("[%s] parcours d'une zone fragmentee par mem_show() :\n", LAYOUT);
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        void *previous = NULL, *current;
+        int keep = 0;
+
+        mem_init_engine(memory, BENCH_MEMORY_SIZE, engines[e].engine);
+        random_state = 88172645463325252UL;
+        while ((current = mem_alloc(16 + next_random() % 240)) != NULL) {
+            if (keep)
+                mem_free(previous);
+            previous = current;
+            keep = !keep;
+        }
+
+        // On garde le parcours le plus rapide, moins sensible aux interruptions que la moyenne.
+        double best = 0;
+        for (int i = 0; i < SHOW_ROUNDS; i++) {
+            shown_blocks = 0;
+            double start = now_ns();
+            mem_show(count_block);
+            double elapsed = now_ns() - start;
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        printf("  %-6s : %6zu blocs, %6.2f ns par bloc (meilleur parcours)\n",
+               engines[e].name, shown_blocks, best / shown_blocks);
+    }
+}
+
+/* Tas minimal nécessaire pour rejouer une trace sans échec, selon les indications de durée de vie données :
+ * aucune, apprises en ligne par site (hint.c) ou exactes (durées de vie connues d'avance).
+ * La taille minimale est cherchée par dichotomie, au Kio près.
+ */
+#define TRACE_ENV "BENCH_TRACE"
+#define TRACE_MAX_HEAP (64L << 20)
+#define SYNTHETIC_ALLOCATIONS 60000
+
+struct trace_op {
+    long alloc;   /* pour une libération, indice de l'allocation libérée ; -1 pour une allocation */
+    size_t size;
+    void *site;
+    int long_lived; /* pour une allocation : durée de vie supérieure à HINT_LONG_LIFETIME allocations */
+};
+
+static struct trace_op *trace;
+static size_t trace_length, trace_allocations;
+
+static void trace_push(long alloc, size_t size, void *site) {
+    static size_t capacity;
+
+    if (trace_length == capacity) {
+        capacity = capacity ? 2 * capacity : 1024;
+        trace = realloc(trace, capacity * sizeof(*trace));
+    }
+    trace[trace_length++] = (struct trace_op) { alloc, size, site, 0 };
+    if (alloc < 0)
+        trace_allocations++;
+}
+
+/* Trace synthétique : quelques sites de tampons temporaires libérés presque aussitôt,
+ * et deux sites de structures à longue durée de vie, libérées bien plus tard ou jamais.
+ */
+static void trace_synthetic() {
+    long *deaths = calloc(SYNTHETIC_ALLOCATIONS, sizeof(long)); /* liste des allocations à libérer à chaque étape */
+    long *next = malloc(SYNTHETIC_ALLOCATIONS * sizeof(long));
+    long *index = malloc(SYNTHETIC_ALLOCATIONS * sizeof(long));
+
+    random_state = 88172645463325252UL;
+    for (long i = 0; i < SYNTHETIC_ALLOCATIONS; i++) {
+        for (long a = deaths[i] - 1; a >= 0; a = next[a] - 1)
+            trace_push(index[a], 0, NULL);
+
+        int long_site = next_random() % 64 == 0;
+        unsigned long site = long_site ? 6 + next_random() % 2 : next_random() % 6;
+        long lifetime = long_site ? 20000 + next_random() % 60000 : 1 + next_random() % 64;
+
+        index[i] = trace_length;
+        trace_push(-1, 16 << (next_random() % (long_site ? 6 : 5)), (void *) (0x400000 + 16 * site));
+        if (i + lifetime < SYNTHETIC_ALLOCATIONS) {
+            next[i] = deaths[i + lifetime];
+            deaths[i + lifetime] = i + 1;
+        }
+    }
+
+    free(deaths);
+    free(next);
+    free(index);
+}
+
+/* Table d'association des pointeurs de la trace enregistrée vers l'indice de leur allocation (adressage ouvert).
+ * Une zone libérée garde son entrée, avec l'indice -1, jusqu'à ce que son adresse soit réutilisée.
+ */
+static uint64_t *trace_keys;
+static long *trace_values;
+static size_t trace_mask;
+
+static size_t trace_slot(uint64_t ptr) {
+    size_t i = (ptr >> 4) & trace_mask;
+
+    while (trace_keys[i] != 0 && trace_keys[i] != ptr)
+        i = (i + 1) & trace_mask;
+    return i;
+}
+
+static void trace_alloc(uint64_t ptr, size_t size, uint64_t site) {
+    size_t i;
+
+    if (ptr == 0)
+        return;
+    if (2 * (trace_allocations + 1) > trace_mask) {
+        uint64_t *keys = trace_keys;
+        long *values = trace_values;
+        size_t old = keys ? trace_mask + 1 : 0;
+
+        trace_mask = old ? 2 * old - 1 : 4095;
+        trace_keys = calloc(trace_mask + 1, sizeof(uint64_t));
+        trace_values = malloc((trace_mask + 1) * sizeof(long));
+        for (size_t j = 0; j < old; j++)
+            if (keys[j] != 0) {
+                i = trace_slot(keys[j]);
+                trace_keys[i] = keys[j];
+                trace_values[i] = values[j];
+            }
+        free(keys);
+        free(values);
+    }
+    i = trace_slot(ptr);
+    trace_keys[i] = ptr;
+    trace_values[i] = trace_length;
+    trace_push(-1, size, (void *) (uintptr_t) site);
+}
+
+static void trace_free(uint64_t ptr) {
+    size_t i;
+
+    if (ptr == 0 || trace_keys == NULL)
+        return;
+    i = trace_slot(ptr);
+    if (trace_keys[i] == ptr && trace_values[i] >= 0) {
+        trace_push(trace_values[i], 0, NULL);
+        trace_values[i] = -1;
+    }
+}
+
+static int compare_events(const void *a, const void *b) {
+    const struct log_event *x = a, *y = b;
+
+    return (x->time > y->time) - (x->time < y->time);
+}
+
+/* Charge le premier vidage du journal : les appels de tous les threads sont rejoués dans l'ordre de leurs dates. */
+static int trace_load(const char *file) {
+    struct log_dump_header header;
+    struct log_event *events = NULL;
+    size_t count = 0;
+    FILE *f = fopen(file, "rb");
+
+    if (f == NULL) {
+        perror(file);
+        return 0;
+    }
+    while (fread(&header, sizeof(header), 1, f) == 1 && header.magic == LOG_MAGIC
+           && (header.thread != 0 || count == 0)) {
+        events = realloc(events, (count + header.count) * sizeof(*events));
+        count += fread(events + count, sizeof(*events), header.count, f);
+    }
+    fclose(f);
+    qsort(events, count, sizeof(*events), compare_events);
+
+    for (size_t i = 0; i < count; i++) {
+        struct log_event *e = &events[i];
+
+        switch (e->op) {
+            case LOG_MALLOC:
+            case LOG_CALLOC:
+                trace_alloc(e->result, e->size, e->site);
+                break;
+            case LOG_REALLOC:
+                if (e->result != e->ptr && e->result != 0) {
+                    trace_free(e->ptr);
+                    trace_alloc(e->result, e->size, e->site);
+                }
+                break;
+            case LOG_FREE:
+            case LOG_FREE_SIZED:
+                trace_free(e->ptr);
+                break;
+        }
+    }
+
+    free(events);
+    free(trace_keys);
+    free(trace_values);
+    return trace_length != 0;
+}
+
+// Marque les allocations dont la durée de vie, comptée en allocations comme dans hint.c, est longue.
+static void trace_oracle() {
+    long *births = malloc(trace_length * sizeof(long));
+    long clock = 0;
+
+    for (size_t i = 0; i < trace_length; i++) {
+        if (trace[i].alloc < 0) {
+            births[i] = clock++;
+            trace[i].long_lived = 1;
+        } else {
+            trace[trace[i].alloc].long_lived = clock - births[trace[i].alloc] > HINT_LONG_LIFETIME;
+        }
+    }
+    free(births);
+}
+
+enum replay_mode { REPLAY_NONE, REPLAY_LEARNED, REPLAY_ORACLE };
+
+// Rejoue la trace dans un tas de size octets ; retourne 1 si aucune allocation n'échoue.
+static int trace_replay(char *heap, size_t size, enum replay_mode mode, void **ptrs) {
+    mem_init(heap, size);
+    hint_reset();
+
+    for (size_t i = 0; i < trace_length; i++) {
+        struct trace_op *op = &trace[i];
+
+        if (op->alloc >= 0) {
+            if (mode == REPLAY_LEARNED)
+                hint_free(ptrs[op->alloc]);
+            mem_free(ptrs[op->alloc]);
+        } else if (mode == REPLAY_LEARNED) {
+            ptrs[i] = hint_alloc(op->size, op->site);
+        } else {
+            ptrs[i] = mem_alloc_hint(op->size, mode == REPLAY_ORACLE
+                                     ? (op->long_lived ? MEM_HINT_LONG : MEM_HINT_SHORT) : MEM_HINT_NONE);
+        }
+        if (op->alloc < 0 && ptrs[i] == NULL)
+            return 0;
+    }
+    return 1;
+}
+
+static void bench_hint() {
+    static const char *modes[] = { "sans indication", "apprises", "exactes" };
+    const char *file = getenv(TRACE_ENV);
+    char *heap = malloc(TRACE_MAX_HEAP);
+    void **ptrs;
+
+    trace = NULL;
+    trace_length = trace_allocations = 0;
+    if (file == NULL || !trace_load(file))
+        trace_synthetic();
+    trace_oracle();
+    ptrs = malloc(trace_length * sizeof(void *));
+
+    printf("[%s] tas minimal pour la trace %s (%zu allocations) :\n",
+           LAYOUT, file ? file : "synthetique", trace_allocations);
+    for (int mode = REPLAY_NONE; mode <= REPLAY_ORACLE; mode++) {
+        size_t low = 0, high = TRACE_MAX_HEAP; /* low échoue, high réussit */
+
+        if (!trace_replay(heap, high, mode, ptrs)) {
+            printf("  %-16s : plus de %ld Kio\n", modes[mode], TRACE_MAX_HEAP >> 10);
+            continue;
+        }
+        while (high - low > 1024) {
+            size_t middle = (low + high) / 2 & ~(size_t) 1023;
+
+            if (trace_replay(heap, middle, mode, ptrs))
+                high = middle;
+            else
+                low = middle;
+        }
+        printf("  %-16s : %6zu Kio\n", modes[mode], high >> 10);
+    }
+
+    free(ptrs);
+    free(trace);
+    free(heap);
+}
+
+static const struct {
+    const char *name;
+    void (*run)();
+} benches[] = {
+    { "capacity", bench_capacity },
+    { "throughput", bench_throughput },
+    { "fragmentation", bench_fragmentation },
+    { "show", bench_show },
+    { "hint", bench_hint },
+};
+
+int main(int argc, char *argv[]) {
+    memory = malloc(BENCH_MEMORY_SIZE);
+    if (memory == NULL)
+        return 1;
+
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        int selected = argc == 1;
+
+        for (int j = 1; j < argc; j++)
+            selected = selected || strcmp(argv[j], benches[i].name) == 0;
+        if (selected)
+            benches[i].run();
+    }
+
+    free(memory);
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "mem_resource.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <vector>
+
+/* Banc d'essai des conteneurs std::pmr sur mem_resource, comparés aux conteneurs usuels (std::allocator, donc le
+ * malloc() de la libc) : pour chaque charge, durée moyenne d'une répétition sur une zone neuve.
+ * Usage : bench_pmr
+ */
+
+#define ZONE_SIZE (64L << 20)
+#define REPEAT 10
+#define ELEMENTS 10000
+
+// Conteneurs usuels et conteneurs std::pmr, avec le type d'allocateur qui permet de les construire.
+struct standard {
+    template <class T> using vector = std::vector<T>;
+    template <class T> using list = std::list<T>;
+    template <class K, class V> using map = std::map<K, V>;
+    using allocator = std::allocator<std::byte>;
+};
+
+struct polymorphic {
+    template <class T> using vector = std::pmr::vector<T>;
+    template <class T> using list = std::pmr::list<T>;
+    template <class K, class V> using map = std::pmr::map<K, V>;
+    using allocator = std::pmr::polymorphic_allocator<std::byte>;
+};
+
+// Générateur pseudo-aléatoire reproductible (xorshift), comme dans bench.c.
+static unsigned long random_state;
+
+static unsigned long next_random() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+// Remplissage par push_back(), avec les réallocations successives du tableau.
+template <class C> static void vector_workload(typename C::allocator a) {
+    typename C::template vector<int> v(a);
+
+    for (int i = 0; i < ELEMENTS * 10; i++)
+        v.push_back(i);
+}
+
+// Insertions puis suppression d'un élément sur deux et remplissage des trous : beaucoup de petits nœuds.
+template <class C> static void list_workload(typename C::allocator a) {
+    typename C::template list<int> l(a);
+
+    for (int i = 0; i < ELEMENTS; i++)
+        l.push_back(i);
+    for (auto it = l.begin(); it != l.end() && (it = l.erase(it)) != l.end(); ++it)
+        ;
+    for (auto it = l.begin(); it != l.end(); ++it)
+        l.insert(it, 0);
+}
+
+// Insertions et suppressions de clés aléatoires dans un arbre.
+template <class C> static void map_workload(typename C::allocator a) {
+    typename C::template map<unsigned long, int> m(a);
+
+    random_state = 88172645463325252UL;
+    for (int i = 0; i < ELEMENTS * 4; i++) {
+        unsigned long key = next_random() % ELEMENTS;
+        auto it = m.find(key);
+
+        if (it != m.end())
+            m.erase(it);
+        else
+            m.emplace(key, i);
+    }
+}
+
+// Durée moyenne (en microsecondes) d'une répétition de run, qui reçoit la zone à utiliser.
+template <class Run> static double measure(Run run) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (int r = 0; r < REPEAT; r++)
+        run();
+
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / REPEAT;
+}
+
+template <class Workload> static void bench(const char *name, char *zone, Workload workload) {
+    double standard_us = measure([&] { workload(standard::allocator(), (standard *) nullptr); });
+    double first_us = measure([&] {
+        mem_resource heap(zone, ZONE_SIZE);
+        workload(polymorphic::allocator(&heap), (polymorphic *) nullptr);
+    });
+    double best_us = measure([&] {
+        mem_resource heap(zone, ZONE_SIZE);
+        heap.fit(&mem_fit_best);
+        workload(polymorphic::allocator(&heap), (polymorphic *) nullptr);
+    });
+    double buddy_us = measure([&] {
+        mem_resource heap(zone, ZONE_SIZE, MEM_ENGINE_BUDDY);
+        workload(polymorphic::allocator(&heap), (polymorphic *) nullptr);
+    });
+    double pool_us = measure([&] {
+        mem_resource heap(zone, ZONE_SIZE);
+        std::pmr::unsynchronized_pool_resource pool(&heap);
+        workload(polymorphic::allocator(&pool), (polymorphic *) nullptr);
+    });
+
+    std::printf("  %-6s : std::allocator %9.1f us, mem_resource first %9.1f us, best %9.1f us, buddy %9.1f us, "
+                "pool sur first %9.1f us\n", name, standard_us, first_us, best_us, buddy_us, pool_us);
+}
+
+int main() {
+    char *zone = static_cast<char *>(std::malloc(ZONE_SIZE));
+
+    if (zone == nullptr)
+        return 1;
+
+    std::printf("[pmr] duree moyenne d'une repetition (%d elements) :\n", ELEMENTS);
+    bench("vector", zone, [](auto a, auto *c) { vector_workload<std::remove_pointer_t<decltype(c)>>(a); });
+    bench("list", zone, [](auto a, auto *c) { list_workload<std::remove_pointer_t<decltype(c)>>(a); });
+    bench("map", zone, [](auto a, auto *c) { map_workload<std::remove_pointer_t<decltype(c)>>(a); });
+
+    std::free(zone);
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include "config.h"
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/* La configuration est lue avant que l'allocateur soit prêt : on n'utilise donc ni stdio ni aucune fonction
+ * susceptible d'appeler malloc(), les messages d'erreur sont écrits directement avec write().
+ */
+static void config_error(const char *option, size_t length, const char *message) {
+    char buffer[256];
+    size_t n = 0;
+    const char *parts[] = { CONFIG_ENV ": option \"", option, "\" ", message, "\n" };
+    size_t lengths[] = { strlen(parts[0]), length, 2, strlen(message), 1 };
+
+    for (int i = 0; i < 5; i++) {
+        size_t part = lengths[i] < sizeof(buffer) - n ? lengths[i] : sizeof(buffer) - n;
+
+        memcpy(buffer + n, parts[i], part);
+        n += part;
+    }
+
+    if (write(STDERR_FILENO, buffer, n) < 0)
+        return;
+}
+
+// Retourne 1 si la valeur [value, value + length[ vaut exactement word.
+static int value_is(const char *value, size_t length, const char *word) {
+    return strlen(word) == length && strncmp(value, word, length) == 0;
+}
+
+/* Convertit une taille éventuellement suivie d'un suffixe k, m ou g (puissances de 1024).
+ * Retourne 0 si la valeur est invalide ou ne tient pas dans un size_t.
+ */
+static size_t parse_size(const char *value, size_t length) {
+    size_t result = 0, i, shift;
+
+    for (i = 0; i < length && value[i] >= '0' && value[i] <= '9'; i++) {
+        if (result > (SIZE_MAX - (value[i] - '0')) / 10)
+            return 0;
+        result = result * 10 + (value[i] - '0');
+    }
+
+    if (i == 0)
+        return 0;
+
+    if (i + 1 == length) {
+        switch (value[i]) {
+            case 'k': case 'K': shift = 10; break;
+            case 'm': case 'M': shift = 20; break;
+            case 'g': case 'G': shift = 30; break;
+            default: return 0;
+        }
+        return result > SIZE_MAX >> shift ? 0 : result << shift;
+    }
+
+    return i == length ? result : 0;
+}
+
+// Applique l'option [option, option + length[ à c.
+static void config_option(const char *option, size_t length, struct config *c) {
+    const char *colon = memchr(option, ':', length);
+
+    if (colon == NULL) {
+        config_error(option, length, "sans valeur, ignoree");
+        return;
+    }
+
+    size_t key_length = colon - option;
+    const char *value = colon + 1;
+    size_t value_length = length - key_length - 1;
+
+    if (value_is(option, key_length, "strategy")) {
+        if (value_is(value, value_length, "first"))
+            c->fit = &mem_fit_first;
+        else if (value_is(value, value_length, "best"))
+            c->fit = &mem_fit_best;
+        else if (value_is(value, value_length, "worst"))
+            c->fit = &mem_fit_worst;
+        else
+            config_error(option, length, "inconnue (first, best ou worst), ignoree");
+    } else if (value_is(option, key_length, "engine")) {
+        if (value_is(value, value_length, "list"))
+            c->engine = MEM_ENGINE_LIST;
+        else if (value_is(value, value_length, "buddy"))
+            c->engine = MEM_ENGINE_BUDDY;
+        else if (value_is(value, value_length, "bitmap"))
+            c->engine = MEM_ENGINE_BITMAP;
+        else
+            config_error(option, length, "inconnue (list, buddy ou bitmap), ignoree");
+    } else if (value_is(option, key_length, "heap")) {
+        size_t heap = parse_size(value, value_length);
+
+        if (heap == 0)
+            config_error(option, length, "invalide, ignoree");
+        else
+            c->heap = heap;
+    } else if (value_is(option, key_length, "hint")) {
+        if (value_is(value, value_length, "learn"))
+            c->hint = 1;
+        else if (value_is(value, value_length, "off"))
+            c->hint = 0;
+        else
+            config_error(option, length, "inconnue (learn ou off), ignoree");
+    } else if (value_is(option, key_length, "background")) {
+        if (value_is(value, value_length, "off"))
+            c->background = MAINT_OFF;
+        else if (value_is(value, value_length, "thread"))
+            c->background = MAINT_THREAD;
+        else if (value_is(value, value_length, "sync"))
+            c->background = MAINT_SYNC;
+        else
+            config_error(option, length, "inconnue (off, thread ou sync), ignoree");
+    } else if (value_is(option, key_length, "budget")) {
+        size_t budget = parse_size(value, value_length);
+
+        if (budget == 0 || budget > 100)
+            config_error(option, length, "invalide (1 a 100), ignoree");
+        else
+            c->budget = budget;
+    } else if (value_is(option, key_length, "arenas")) {
+        config_error(option, length, "ignoree : l'allocateur ne gere qu'un seul tas");
+    } else {
+        config_error(option, length, "inconnue, ignoree");
+    }
+}
+
+void config_parse(const char *s, struct config *c) {
+    while (s != NULL && *s != '\0') {
+        const char *end = strchr(s, ',');
+        size_t length = end != NULL ? (size_t) (end - s) : strlen(s);
+
+        if (length > 0)
+            config_option(s, length, c);
+
+        s = end != NULL ? end + 1 : NULL;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+#include "mem.h"
+#include "maintenance.h"
+
+/* Configuration de libmalloc.so
+ *
+ * Lue une seule fois au chargement de la bibliothèque dans la variable d'environnement LIBMALLOC_CONF,
+ * sous la forme d'une liste d'options "clé:valeur" séparées par des virgules, par exemple :
+ *     LIBMALLOC_CONF=strategy:best,heap:1g
+ *
+ * Options reconnues :
+ *     strategy:first|best|worst   stratégie de recherche de bloc libre (first par défaut)
+ *     engine:list|buddy|bitmap    moteur gérant le tas : liste de blocs libres (par défaut), système de compagnons
+ *                                 ou tables de bits hors des blocs
+ *     heap:taille[k|m|g]          taille du tas, obtenu par mmap() (zone statique de common.c par défaut, ou avec
+ *                                 un avertissement si mmap() échoue ou si le moteur refuse cette taille)
+ *     background:off|thread|sync  maintenance du tas (maintenance.h) : désactivée (par défaut), par un thread, ou
+ *                                 par les appels eux-mêmes
+ *     budget:n                    temps processeur de la maintenance, en pourcentage d'un processeur (5 par défaut)
+ *     hint:learn|off              apprentissage des durées de vie par site d'allocation (désactivé par défaut)
+ *     arenas:n                    acceptée pour compatibilité, l'allocateur ne gère qu'un seul tas
+ */
+
+#define CONFIG_ENV "LIBMALLOC_CONF"
+
+struct config {
+    mem_fit_function_t *fit;
+    enum mem_engine engine;
+    size_t heap; /* 0 : zone statique de common.c */
+    int hint;    /* 1 : indications de durée de vie apprises par site (hint.h) */
+    enum maint_mode background;
+    int budget;  /* pourcentage d'un processeur */
+};
+
+/* Remplit c à partir de la chaîne s (les options invalides sont signalées sur stderr et ignorées) */
+void config_parse(const char *s, struct config *c);
+
+#endif
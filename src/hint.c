@@ -0,0 +1,93 @@
+#include "hint.h"
+#include <stdint.h>
+
+struct site {
+    void *site;
+    uint64_t lifetime; /* moyenne glissante des durées de vie observées */
+    uint32_t samples;
+    uint32_t calls;    /* allocations du site, pour en échantillonner une sur HINT_SAMPLE_RATE */
+};
+
+struct sample {
+    void *ptr;
+    struct site *site;
+    uint64_t birth;
+};
+
+int hint_learning = 0;
+
+static struct site sites[HINT_SITES];
+static struct sample samples[HINT_SAMPLES];
+static uint64_t now;
+
+// Retourne l'entrée du site (en la créant si besoin), ou NULL si la table est pleine.
+static struct site *find_site(void *site) {
+    size_t i = ((uintptr_t) site >> 2) & (HINT_SITES - 1);
+
+    for (size_t n = 0; n < HINT_SITES; n++, i = (i + 1) & (HINT_SITES - 1)) {
+        if (sites[i].site == site)
+            return &sites[i];
+        if (sites[i].site == NULL) {
+            sites[i] = (struct site) { site, 0, 0, 0 };
+            return &sites[i];
+        }
+    }
+    return NULL;
+}
+
+// Retourne l'emplacement de l'échantillon correspondant à ptr.
+static struct sample *find_sample(void *ptr) {
+    return &samples[((uintptr_t) ptr >> 4) & (HINT_SAMPLES - 1)];
+}
+
+// Prend en compte une durée de vie observée pour le site s.
+static void observe(struct site *s, uint64_t lifetime) {
+    s->lifetime = s->samples == 0 ? lifetime : (3 * s->lifetime + lifetime) / 4;
+    if (s->samples < UINT32_MAX)
+        s->samples++;
+}
+
+static enum mem_hint site_hint(struct site *s) {
+    if (s == NULL || s->samples < HINT_MIN_SAMPLES)
+        return MEM_HINT_NONE;
+    return s->lifetime > HINT_LONG_LIFETIME ? MEM_HINT_LONG : MEM_HINT_SHORT;
+}
+
+enum mem_hint hint_for_site(void *site) {
+    return site_hint(find_site(site));
+}
+
+void *hint_alloc(size_t size, void *site) {
+    struct site *s = find_site(site);
+    void *ptr = mem_alloc_hint(size, site_hint(s));
+
+    now++;
+    // Échantillonnage par site : un site rare n'attend pas que le compteur global tombe sur lui.
+    if (ptr != NULL && s != NULL && ++s->calls % HINT_SAMPLE_RATE == 0) {
+        struct sample *sample = find_sample(ptr);
+
+        /* L'échantillon remplacé est encore vivant : sa durée de vie est au moins celle écoulée,
+         * ce qui évite de ne jamais rien apprendre des zones qui ne sont pas libérées. */
+        if (sample->ptr != NULL)
+            observe(sample->site, now - sample->birth);
+        *sample = (struct sample) { ptr, s, now };
+    }
+    return ptr;
+}
+
+void hint_free(void *ptr) {
+    struct sample *sample = find_sample(ptr);
+
+    if (sample->ptr == ptr) {
+        observe(sample->site, now - sample->birth);
+        sample->ptr = NULL;
+    }
+}
+
+void hint_reset() {
+    for (size_t i = 0; i < HINT_SITES; i++)
+        sites[i] = (struct site) { NULL, 0, 0, 0 };
+    for (size_t i = 0; i < HINT_SAMPLES; i++)
+        samples[i] = (struct sample) { NULL, NULL, 0 };
+    now = 0;
+}
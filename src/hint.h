@@ -0,0 +1,35 @@
+#ifndef __HINT_H__
+#define __HINT_H__
+#include "mem.h"
+
+/* Apprentissage des durées de vie par site d'allocation
+ *
+ * Une allocation sur HINT_SAMPLE_RATE de chaque site est échantillonnée : on note son site (adresse de retour de malloc())
+ * et sa date, mesurée en nombre d'allocations. À sa libération, sa durée de vie met à jour la moyenne glissante de son site.
+ * Les sites dont la durée de vie moyenne dépasse HINT_LONG_LIFETIME allouent ensuite avec MEM_HINT_LONG, les autres
+ * avec MEM_HINT_SHORT, une fois HINT_MIN_SAMPLES durées observées.
+ * Les tables sont de taille fixe et allouées statiquement : aucun appel à malloc() n'est nécessaire.
+ */
+
+#define HINT_SITES 1024         /* puissance de 2 */
+#define HINT_SAMPLES 256        /* puissance de 2 */
+#define HINT_SAMPLE_RATE 16
+#define HINT_MIN_SAMPLES 4
+#define HINT_LONG_LIFETIME 4096
+
+/* vaut 1 si l'apprentissage est activé (LIBMALLOC_CONF=hint:learn) */
+extern int hint_learning;
+
+/* Alloue size octets pour le site site, avec l'indication apprise pour ce dernier */
+void *hint_alloc(size_t size, void *site);
+
+/* À appeler avant de libérer ptr, pour mesurer la durée de vie des zones échantillonnées */
+void hint_free(void *ptr);
+
+/* Indication actuellement associée au site */
+enum mem_hint hint_for_site(void *site);
+
+/* Oublie tout ce qui a été appris */
+void hint_reset();
+
+#endif
@@ -0,0 +1,141 @@
+#include "log.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Tampon circulaire d'un thread
+ * head compte les enregistrements écrits depuis le début : seul le thread propriétaire l'incrémente,
+ * log_dump() se contente de le lire, ce qui évite tout verrou.
+ * dumped est la valeur de head lors du vidage précédent : seul log_dump() le modifie.
+ */
+struct log_ring {
+    uint64_t head;
+    uint64_t dumped;
+    struct log_event events[LOG_RING_SIZE];
+};
+
+int log_enabled = 0;
+
+static int log_fd = -1;
+// Tampons des threads, projetés par log_init() seulement si le journal est activé.
+static struct log_ring *rings;
+static unsigned int rings_count = 0;
+
+static __thread struct log_ring *ring;
+static __thread int ring_registered = 0;
+
+// Retourne le tampon du thread appelant, en lui en attribuant un lors de son premier appel (NULL s'il n'en reste plus).
+static struct log_ring *get_ring() {
+    if (!ring_registered) {
+        unsigned int i = __atomic_fetch_add(&rings_count, 1, __ATOMIC_RELAXED);
+
+        ring = i < LOG_MAX_THREADS ? &rings[i] : NULL;
+        ring_registered = 1;
+    }
+    return ring;
+}
+
+static void log_signal(int sig) {
+    (void) sig;
+    log_dump();
+}
+
+/* Active le journal si LIBMALLOC_LOG désigne un fichier que l'on peut créer.
+ * Les tampons sont projetés avec mmap() (malloc() est justement la fonction journalisée) : les pages ne sont
+ * réellement occupées qu'une fois écrites. Le gestionnaire de LOG_SIGNAL n'est installé que si le signal a encore
+ * son action par défaut, pour ne pas remplacer celui de l'application.
+ */
+void log_init() {
+    struct sigaction action = { 0 }, current;
+    char *path = getenv(LOG_ENV);
+
+    if (path == NULL || *path == '\0')
+        return;
+
+    log_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (log_fd < 0)
+        return;
+
+    rings = mmap(NULL, LOG_MAX_THREADS * sizeof(struct log_ring), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (rings == MAP_FAILED) {
+        rings = NULL;
+        close(log_fd);
+        log_fd = -1;
+        return;
+    }
+
+    if (sigaction(LOG_SIGNAL, NULL, &current) == 0 && !(current.sa_flags & SA_SIGINFO)
+        && current.sa_handler == SIG_DFL) {
+        action.sa_handler = log_signal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(LOG_SIGNAL, &action, NULL);
+    }
+
+    log_enabled = 1;
+}
+
+void log_event(enum log_op op, void *ptr, size_t size, void *result, void *site) {
+    struct log_ring *r = get_ring();
+    struct timespec now;
+
+    if (r == NULL)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    r->events[r->head & (LOG_RING_SIZE - 1)] = (struct log_event) {
+        (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec,
+        (uintptr_t) ptr,
+        (uintptr_t) result,
+        (uintptr_t) site,
+        (uint32_t) size,
+        op
+    };
+    // L'enregistrement doit être complet avant d'être visible par log_dump().
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+/* Écrit dans le fichier du journal les enregistrements de chaque tampon arrivés depuis le vidage précédent, du plus ancien
+ * au plus récent : un vidage sur LOG_SIGNAL ne réécrit pas ce qui est déjà dans le fichier. Si plus de LOG_RING_SIZE
+ * enregistrements ont été écrits entre deux vidages, seuls les LOG_RING_SIZE derniers sont encore disponibles.
+ * Chaque tampon reçoit un en-tête, même sans nouvel enregistrement, pour que logdump repère le début de chaque vidage.
+ * On n'utilise que write() : la fonction peut donc être appelée depuis un gestionnaire de signal.
+ * Les enregistrements écrits par les autres threads pendant la copie peuvent apparaître incomplets.
+ */
+void log_dump() {
+    unsigned int n = __atomic_load_n(&rings_count, __ATOMIC_RELAXED);
+
+    if (log_fd < 0)
+        return;
+
+    if (n > LOG_MAX_THREADS)
+        n = LOG_MAX_THREADS;
+
+    for (unsigned int i = 0; i < n; i++) {
+        uint64_t head = __atomic_load_n(&rings[i].head, __ATOMIC_ACQUIRE);
+        uint64_t count = head - rings[i].dumped < LOG_RING_SIZE ? head - rings[i].dumped : LOG_RING_SIZE;
+        size_t first = (head - count) & (LOG_RING_SIZE - 1);
+        struct log_dump_header header = { LOG_MAGIC, i, count };
+
+        if (write(log_fd, &header, sizeof(header)) != sizeof(header))
+            return;
+
+        // Les enregistrements les plus anciens peuvent se trouver en fin de tampon : on écrit alors deux morceaux.
+        size_t part = first + count > LOG_RING_SIZE ? LOG_RING_SIZE - first : count;
+        if (write(log_fd, &rings[i].events[first], part * sizeof(struct log_event)) < 0
+            || write(log_fd, &rings[i].events[0], (count - part) * sizeof(struct log_event)) < 0)
+            return;
+        rings[i].dumped = head;
+    }
+}
+
+// Vidage du journal à la fin du programme.
+__attribute__((destructor))
+static void log_fini() {
+    if (log_enabled)
+        log_dump();
+}
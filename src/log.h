@@ -0,0 +1,69 @@
+#ifndef __LOG_H__
+#define __LOG_H__
+#include <stddef.h>
+#include <stdint.h>
+
+/* Journal binaire des appels à libmalloc.so
+ *
+ * Chaque thread écrit des enregistrements de taille fixe dans son propre tampon circulaire, sans verrou ni formatage.
+ * Le journal est activé à l'exécution en donnant un nom de fichier dans la variable d'environnement LIBMALLOC_LOG :
+ * le contenu des tampons y est écrit à la fin du programme et à chaque réception du signal LOG_SIGNAL,
+ * sauf si l'application a déjà installé son propre gestionnaire pour ce signal (il n'est alors pas remplacé).
+ * Le programme logdump décode ensuite ce fichier.
+ */
+
+#define LOG_ENV "LIBMALLOC_LOG"
+#define LOG_SIGNAL SIGUSR2
+
+/* nombre d'enregistrements conservés par thread (puissance de 2) et nombre maximal de threads journalisés */
+#define LOG_RING_SIZE 4096
+#define LOG_MAX_THREADS 64
+
+#define LOG_MAGIC 0x4d4c4f47 /* "MLOG" */
+
+enum log_op {
+    LOG_MALLOC,
+    LOG_CALLOC,
+    LOG_REALLOC,
+    LOG_FREE,
+    LOG_FREE_SIZED,
+    LOG_MALLOC_BATCH,
+    LOG_FREE_BATCH,
+    LOG_NEW,    /* operator new de libmallocxx.so */
+    LOG_DELETE, /* operator delete, avec la taille si elle est donnée (0 sinon) */
+};
+
+/* Enregistrement d'un appel : 40 octets quel que soit le mode de compilation */
+struct log_event {
+    uint64_t time;   /* date de l'appel, en nanosecondes (CLOCK_MONOTONIC) */
+    uint64_t ptr;    /* pointeur passé en paramètre (NULL pour malloc) */
+    uint64_t result; /* pointeur retourné (NULL pour free) */
+    uint64_t site;   /* adresse de retour de l'appel, qui identifie le site d'allocation */
+    uint32_t size;   /* taille demandée (ou nombre de zones pour les appels groupés) */
+    uint32_t op;     /* enum log_op */
+};
+
+/* En-tête précédant, dans le fichier, les enregistrements d'un thread */
+struct log_dump_header {
+    uint32_t magic;
+    uint32_t thread; /* numéro d'enregistrement du thread, dans l'ordre de leur premier appel */
+    uint64_t count;  /* nombre d'enregistrements qui suivent, arrivés depuis le vidage précédent */
+};
+
+/* vaut 1 si le journal a été activé par log_init() */
+extern int log_enabled;
+
+void log_init();
+void log_event(enum log_op op, void *ptr, size_t size, void *result, void *site);
+void log_dump();
+
+/* Journalise un appel : une seule comparaison, prédite non prise, quand le journal est désactivé.
+ * À utiliser directement dans les fonctions exportées, pour que l'adresse de retour soit celle de leur appelant.
+ */
+#define LOG_EVENT(op, ptr, size, result)                                        \
+    do {                                                                        \
+        if (__builtin_expect(log_enabled, 0))                                   \
+            log_event(op, ptr, size, result, __builtin_return_address(0));      \
+    } while (0)
+
+#endif
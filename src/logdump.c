@@ -0,0 +1,63 @@
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Décodeur du journal binaire de libmalloc.so
+ * Usage : logdump fichier
+ * Le fichier peut contenir plusieurs vidages successifs (un par signal reçu, plus celui de fin de programme).
+ */
+
+static const char *op_names[] = {
+    [LOG_MALLOC] = "malloc",
+    [LOG_CALLOC] = "calloc",
+    [LOG_REALLOC] = "realloc",
+    [LOG_FREE] = "free",
+    [LOG_FREE_SIZED] = "free_sized",
+    [LOG_MALLOC_BATCH] = "malloc_batch",
+    [LOG_FREE_BATCH] = "free_batch",
+    [LOG_NEW] = "new",
+    [LOG_DELETE] = "delete",
+};
+
+int main(int argc, char *argv[]) {
+    struct log_dump_header header;
+    struct log_event event;
+    FILE *f;
+    int dumps = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage : %s fichier\n", argv[0]);
+        return 1;
+    }
+
+    f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    while (fread(&header, sizeof(header), 1, f) == 1) {
+        if (header.magic != LOG_MAGIC) {
+            fprintf(stderr, "Fichier de journal invalide\n");
+            return 1;
+        }
+        if (header.thread == 0)
+            printf("=== Vidage %d ===\n", ++dumps);
+        printf("Thread %u : %llu appels\n", header.thread, (unsigned long long) header.count);
+
+        for (uint64_t i = 0; i < header.count; i++) {
+            if (fread(&event, sizeof(event), 1, f) != 1) {
+                fprintf(stderr, "Journal tronqué\n");
+                return 1;
+            }
+            printf("%llu.%09llu %-12s ptr=%#llx taille=%u -> %#llx (site %#llx)\n",
+                   (unsigned long long) event.time / 1000000000, (unsigned long long) event.time % 1000000000,
+                   event.op < sizeof(op_names) / sizeof(op_names[0]) ? op_names[event.op] : "?",
+                   (unsigned long long) event.ptr, event.size, (unsigned long long) event.result,
+                   (unsigned long long) event.site);
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,255 @@
+#include "maintenance.h"
+#include "mem.h"
+#include "hint.h"
+#include <signal.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Blocs découpés à l'avance pour une petite taille */
+struct cache {
+    size_t count;
+    void *blocks[MAINT_CACHE];
+};
+
+int maint_mode = MAINT_OFF;
+pthread_mutex_t maint_heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int budget_percent;
+static long budget_us; /* temps processeur d'une tranche */
+static uintptr_t page_size;
+
+/* Pile des libérations différées, chaînées par leur premier mot : empilées sans verrou par maint_free(),
+ * détachées d'un bloc par la maintenance, qui range les zones pas encore libérées dans pending (sous le verrou).
+ */
+static void *deferred;
+static void *pending;
+
+/* Les variables suivantes sont protégées par le verrou du tas. */
+static size_t requests;            /* allocations depuis la dernière tranche */
+static size_t hits[MAINT_CLASSES]; /* idem, par petite taille */
+static struct cache caches[MAINT_CLASSES];
+
+static unsigned long ops;          /* opérations depuis le démarrage, en mode sync */
+static int slice_running;          /* une seule tranche à la fois en mode sync */
+static int purged;                 /* 1 si le tas inactif a déjà été purgé (lu et écrit par les seules tranches) */
+
+// Petite taille (16 octets par classe) correspondant à size ; MAINT_CLASSES ou plus si size est trop grande.
+static inline size_t size_class(size_t size) {
+    return size == 0 ? 0 : (size - 1) / 16;
+}
+
+static void *core_alloc(size_t size, void *site) {
+    if (size < MAINT_MIN_SIZE)
+        size = MAINT_MIN_SIZE;
+    if (hint_learning)
+        return hint_alloc(size, site);
+    return mem_alloc(size);
+}
+
+// Libère, verrou pris, jusqu'à MAINT_BATCH zones de la chaîne pending, triées par mem_free_batch().
+static void free_pending() {
+    static void *batch[MAINT_BATCH];
+    size_t n = 0;
+
+    if (pending == NULL)
+        pending = __atomic_exchange_n(&deferred, NULL, __ATOMIC_ACQUIRE);
+
+    // On lit le lien avant la libération, qui peut écraser le début de la zone.
+    while (pending != NULL && n < MAINT_BATCH) {
+        batch[n++] = pending;
+        pending = *(void **) pending;
+    }
+    mem_free_batch(batch, n);
+}
+
+// Rend au tas, verrou pris, tous les blocs découpés à l'avance.
+static void flush_caches() {
+    for (size_t c = 0; c < MAINT_CLASSES; c++) {
+        mem_free_batch(caches[c].blocks, caches[c].count);
+        caches[c].count = 0;
+    }
+}
+
+void *maint_alloc(size_t size, void *site) {
+    size_t c = size_class(size);
+    void *p;
+
+    requests++;
+    if (c < MAINT_CLASSES) {
+        hits[c]++;
+        if (caches[c].count > 0)
+            return caches[c].blocks[--caches[c].count];
+    }
+
+    p = core_alloc(size, site);
+    if (p == NULL) {
+        // Le tas est peut-être plein de zones dont la libération n'a pas encore été faite : on les libère toutes.
+        do
+            free_pending();
+        while (pending != NULL || __atomic_load_n(&deferred, __ATOMIC_RELAXED) != NULL);
+        flush_caches();
+        p = core_alloc(size, site);
+    }
+    return p;
+}
+
+void maint_free(void *ptr) {
+    void *head = __atomic_load_n(&deferred, __ATOMIC_RELAXED);
+
+    if (hint_learning) {
+        pthread_mutex_lock(&maint_heap_lock);
+        hint_free(ptr);
+        pthread_mutex_unlock(&maint_heap_lock);
+    }
+
+    do
+        *(void **) ptr = head;
+    while (!__atomic_compare_exchange_n(&deferred, &head, ptr, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Rend au système les pages d'un grand bloc libre, en laissant intact son début (métadonnées des blocs libres).
+static void purge_block(void *adr, size_t size, int free) {
+    uintptr_t start = ((uintptr_t) adr + 64 + page_size - 1) & ~(page_size - 1);
+    uintptr_t end = ((uintptr_t) adr + size) & ~(page_size - 1);
+
+    if (free && size >= MAINT_PURGE_MIN && end > start)
+        madvise((void *) start, end - start, MADV_DONTNEED);
+}
+
+// Temps processeur consommé par le thread appelant, en microsecondes.
+static long cpu_us() {
+    struct timespec t;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec * 1000000L + t.tv_nsec / 1000;
+}
+
+/* Tranche de maintenance : chaque étape prend le verrou du tas le temps d'un paquet, et s'arrête avec le budget.
+ * Retourne le temps processeur consommé.
+ */
+static long slice() {
+    long start = cpu_us(), remaining;
+    int idle, more;
+
+    /* Libérations différées : toutes celles empilées au début de la tranche, hors budget, pour que la pile ne grossisse
+     * pas plus vite qu'elle n'est vidée (celles empilées entre-temps attendent la tranche suivante).
+     */
+    do {
+        pthread_mutex_lock(&maint_heap_lock);
+        free_pending();
+        more = pending != NULL;
+        pthread_mutex_unlock(&maint_heap_lock);
+    } while (more);
+
+    // Découpage à l'avance pour les petites tailles les plus demandées, et détection de l'inactivité
+    pthread_mutex_lock(&maint_heap_lock);
+    idle = requests < MAINT_IDLE;
+    requests = 0;
+    pthread_mutex_unlock(&maint_heap_lock);
+
+    for (size_t c = 0; c < MAINT_CLASSES && cpu_us() - start < budget_us; c++) {
+        pthread_mutex_lock(&maint_heap_lock);
+        if (hits[c] >= MAINT_HOT)
+            while (caches[c].count < MAINT_CACHE) {
+                size_t n = mem_alloc_batch(16 * (c + 1), MAINT_CACHE - caches[c].count,
+                                           caches[c].blocks + caches[c].count);
+
+                if (n == 0)
+                    break;
+                caches[c].count += n;
+            }
+        hits[c] = 0;
+        pthread_mutex_unlock(&maint_heap_lock);
+    }
+
+    // Tas inactif : on rend les blocs découpés à l'avance, on compacte puis on rend les pages des grands blocs libres.
+    if (!idle) {
+        purged = 0;
+    } else if (!purged && (remaining = budget_us - (cpu_us() - start)) > 0) {
+        pthread_mutex_lock(&maint_heap_lock);
+        flush_caches();
+        purged = !mem_compact(remaining);
+        if (purged)
+            mem_show(purge_block);
+        pthread_mutex_unlock(&maint_heap_lock);
+    }
+
+    return cpu_us() - start;
+}
+
+// arg est la zone de libmalloc.so, à sélectionner pour ce thread (mem_use()).
+static void *maint_thread(void *arg) {
+    mem_use(arg);
+
+    while (1) {
+        long used = slice();
+        // Une tranche qui a dépassé son budget repousse la suivante pour que la moyenne le respecte.
+        long period = used * 100 / budget_percent > MAINT_INTERVAL_MS * 1000L
+                      ? used * 100 / budget_percent : MAINT_INTERVAL_MS * 1000L;
+        long wait = period - used;
+        struct timespec t = { wait / 1000000, wait % 1000000 * 1000 };
+
+        nanosleep(&t, NULL);
+    }
+    return NULL;
+}
+
+void maint_sync_op() {
+    int expected = 0;
+
+    if (__atomic_add_fetch(&ops, 1, __ATOMIC_RELAXED) % MAINT_SYNC_PERIOD != 0)
+        return;
+    if (__atomic_compare_exchange_n(&slice_running, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        slice();
+        __atomic_store_n(&slice_running, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/* fork() : le verrou est pris pendant la copie pour que le tas du fils soit cohérent ;
+ * le fils n'a pas de thread de maintenance et passe en mode sync.
+ */
+static void fork_prepare() {
+    pthread_mutex_lock(&maint_heap_lock);
+}
+
+static void fork_parent() {
+    pthread_mutex_unlock(&maint_heap_lock);
+}
+
+static void fork_child() {
+    pthread_mutex_unlock(&maint_heap_lock);
+    slice_running = 0;
+    maint_mode = MAINT_SYNC;
+}
+
+void maint_init(enum maint_mode mode, int budget) {
+    budget_percent = budget > 0 && budget <= 100 ? budget : MAINT_DEFAULT_BUDGET;
+    budget_us = MAINT_INTERVAL_MS * 1000L * budget_percent / 100;
+    page_size = sysconf(_SC_PAGESIZE);
+    maint_mode = mode;
+}
+
+void maint_start() {
+    pthread_t thread;
+    pthread_attr_t attr;
+    sigset_t all, previous;
+
+    if (maint_mode == MAINT_OFF)
+        return;
+
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+    if (maint_mode != MAINT_THREAD)
+        return;
+
+    // Le thread ne doit recevoir aucun signal destiné au programme : il hérite d'un masque complet.
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, maint_thread, mem_current()) != 0)
+        maint_mode = MAINT_SYNC;
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
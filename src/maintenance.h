@@ -0,0 +1,83 @@
+#ifndef __MAINTENANCE_H__
+#define __MAINTENANCE_H__
+#include <pthread.h>
+#include <stddef.h>
+
+/* Maintenance du tas de libmalloc.so hors du chemin des appels
+ *
+ * Activée par LIBMALLOC_CONF=background:thread (ou background:sync), elle effectue par tranches de MAINT_INTERVAL_MS :
+ *     - les libérations différées : free() empile la zone sans verrou, la maintenance les réinsère par paquets triés
+ *       avec mem_free_batch(), en un seul parcours de la liste des blocs libres par paquet ;
+ *     - le découpage à l'avance de blocs pour les petites tailles les plus demandées (par mem_alloc_batch()),
+ *       que malloc() prend ensuite sans recherche ;
+ *     - quand le tas est inactif, le retour au système des pages des grands blocs libres (madvise(MADV_DONTNEED)),
+ *       après avoir rendu les blocs découpés à l'avance ;
+ *     - le compactage des poignées (mem_compact()) avec le temps restant.
+ * Les libérations différées sont toujours toutes effectuées ; le reste de chaque tranche dispose de budget % de
+ * MAINT_INTERVAL_MS de temps processeur. Une tranche qui le dépasse (un paquet ou un parcours ne s'interrompt pas)
+ * repousse d'autant la suivante.
+ *
+ * Dès que la maintenance est activée, tous les appels de libmalloc.so (et de libmallocxx.so) prennent le verrou du tas :
+ * la maintenance ne le prend que le temps d'un paquet, pour ne pas retarder longtemps les autres threads.
+ * En mode sync, ou si le thread ne peut pas être créé, ou dans le fils d'un fork(), les tranches sont effectuées par les
+ * appels eux-mêmes, toutes les MAINT_SYNC_PERIOD opérations.
+ */
+
+enum maint_mode {
+    MAINT_OFF,
+    MAINT_THREAD,
+    MAINT_SYNC,
+};
+
+#define MAINT_INTERVAL_MS 10
+#define MAINT_DEFAULT_BUDGET 5   /* en pourcentage d'un processeur */
+#define MAINT_SYNC_PERIOD 4096   /* opérations entre deux tranches en mode sync */
+
+#define MAINT_BATCH 256          /* zones réinsérées par prise du verrou */
+#define MAINT_CLASSES 16         /* petites tailles suivies : 16, 32, ..., 256 octets */
+#define MAINT_CACHE 32           /* blocs découpés à l'avance par taille */
+#define MAINT_HOT 64             /* demandes par tranche à partir desquelles une taille est découpée à l'avance */
+#define MAINT_IDLE 16            /* le tas est inactif s'il a reçu moins de demandes pendant une tranche */
+#define MAINT_PURGE_MIN (64 << 10) /* taille minimale d'un bloc libre dont on rend les pages */
+
+/* plus petite taille allouée : une zone libérée doit pouvoir contenir le lien de la pile des libérations différées */
+#define MAINT_MIN_SIZE sizeof(void *)
+
+extern int maint_mode;
+extern pthread_mutex_t maint_heap_lock;
+
+/* Active la maintenance pendant l'initialisation du tas, avant tout appel des autres threads ;
+ * budget en pourcentage d'un processeur */
+void maint_init(enum maint_mode mode, int budget);
+
+/* Crée le thread de maintenance, une fois l'initialisation terminée (pthread_create() peut appeler malloc()) */
+void maint_start();
+
+/* Verrou du tas, qui n'est pris que si la maintenance est active : une seule comparaison, prédite non prise, sinon */
+static inline void maint_lock() {
+    if (__builtin_expect(maint_mode != MAINT_OFF, 0))
+        pthread_mutex_lock(&maint_heap_lock);
+}
+
+static inline void maint_unlock() {
+    if (__builtin_expect(maint_mode != MAINT_OFF, 0))
+        pthread_mutex_unlock(&maint_heap_lock);
+}
+
+/* Allocation de size octets, verrou pris : bloc découpé à l'avance s'il y en a un, sinon mem_alloc() (ou hint_alloc()
+ * pour le site site), et en cas d'échec, nouvel essai après avoir effectué toutes les libérations différées */
+void *maint_alloc(size_t size, void *site);
+
+/* Libération différée de ptr, sans le verrou */
+void maint_free(void *ptr);
+
+/* Effectue une tranche si c'est le tour de l'appelant (mode sync) */
+void maint_sync_op();
+
+/* À appeler après chaque opération, sans le verrou : en mode sync, effectue une tranche toutes les MAINT_SYNC_PERIOD */
+static inline void maint_op() {
+    if (__builtin_expect(maint_mode == MAINT_SYNC, 0))
+        maint_sync_op();
+}
+
+#endif
@@ -1,39 +1,135 @@
 #include "mem.h"
 #include "common.h"
+#include "log.h"
+#include "config.h"
+#include "hint.h"
+#include "stats.h"
+#include "maintenance.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-static __thread int in_lib=0;
+/* État de l'initialisation : 0 pas commencée, 1 en cours, 2 terminée */
+static int init_state = 0;
 
-#define dprintf(args...)			\
-    do {					\
-	if (!in_lib) {				\
-	    in_lib=1;				\
-	    fprintf(stderr, args);		\
-	    in_lib=0;				\
-	}					\
-    } while (0)
+/* Zone de libmalloc.so, et indicateur de sa sélection par le thread (la zone de mem.c est propre à chaque thread) */
+static void *heap_zone;
+static __thread int heap_selected __attribute__((tls_model("initial-exec")));
 
-static
-void init() {
-    static int first=1;
+// Signale que le tas demandé n'a pas pu être utilisé, avec write() : stdio appellerait malloc() pendant l'initialisation.
+static void heap_warning() {
+    static const char message[] = CONFIG_ENV ": tas indisponible (mmap ou taille refusee), zone statique utilisee\n";
 
-    if (first) {
-        mem_init(get_memory_adr(), get_memory_size());
-        first = 0;
+    if (write(STDERR_FILENO, message, sizeof(message) - 1) < 0)
+        return;
+}
+
+/* Initialisation de l'allocateur et du journal selon LIBMALLOC_CONF et LIBMALLOC_LOG.
+ * Elle est faite une seule fois par le constructeur ELF au chargement de la bibliothèque ; un malloc() appelé avant
+ * (par le constructeur d'une autre bibliothèque) la déclenche lui-même. Si plusieurs threads s'y présentent, un seul
+ * l'effectue et les autres attendent qu'elle soit terminée.
+ */
+__attribute__((constructor))
+static void init_once() {
+    int expected = 0;
+    struct config c = { &mem_fit_first, MEM_ENGINE_LIST, 0, 0, MAINT_OFF, MAINT_DEFAULT_BUDGET };
+    void *heap = MAP_FAILED;
+
+    if (!__atomic_compare_exchange_n(&init_state, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&init_state, __ATOMIC_ACQUIRE) != 2)
+            ;
+        return;
+    }
+
+    config_parse(getenv(CONFIG_ENV), &c);
+
+    // mem_init() attend une taille multiple de 8.
+    c.heap &= ~(size_t) 7;
+    if (c.heap != 0)
+        heap = mmap(NULL, c.heap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (heap != MAP_FAILED) {
+        mem_init_engine(heap, c.heap, c.engine);
+        // Un tas trop petit pour le moteur est refusé par mem_init_engine() : on se rabat alors sur la zone statique.
+        if (mem_current() != heap) {
+            munmap(heap, c.heap);
+            heap = MAP_FAILED;
+        }
+    }
+    if (heap == MAP_FAILED) {
+        // Sans option heap, la zone statique est celle demandée et il n'y a rien à signaler.
+        if (c.heap != 0)
+            heap_warning();
+        mem_init_engine(get_memory_adr(), get_memory_size(), c.engine);
+    }
+    mem_fit(c.fit);
+    heap_zone = mem_current();
+    hint_learning = c.hint;
+    maint_init(c.background, c.budget);
+
+    log_init();
+
+    __atomic_store_n(&init_state, 2, __ATOMIC_RELEASE);
+
+    maint_start();
+}
+
+/* Premier appel d'un thread : initialisation si elle n'a pas été faite (appel précédant le constructeur), puis
+ * sélection de la zone de libmalloc.so pour ce thread.
+ */
+static void select_heap() {
+    if (__atomic_load_n(&init_state, __ATOMIC_ACQUIRE) != 2)
+        init_once();
+    mem_use(heap_zone);
+    heap_selected = 1;
+}
+
+// À appeler au début de chaque fonction exportée : une seule comparaison, prédite non prise, après le premier appel.
+static inline void init() {
+    if (__builtin_expect(!heap_selected, 0))
+        select_heap();
+}
+
+
+/* Allocation pour le site site (adresse de retour de la fonction exportée), verrou du tas pris :
+ * avec hint:learn, l'indication de durée de vie est celle apprise pour ce site.
+ */
+static inline void *site_alloc(size_t size, void *site) {
+    if (__builtin_expect(maint_mode != MAINT_OFF, 0))
+        return maint_alloc(size, site);
+    if (__builtin_expect(hint_learning, 0))
+        return hint_alloc(size, site);
+    return mem_alloc(size);
+}
+
+// À appeler avant de libérer une zone, pour l'apprentissage des durées de vie.
+static inline void site_free(void *ptr) {
+    if (__builtin_expect(hint_learning, 0))
+        hint_free(ptr);
+}
+
+/* Libération de ptr, différée si la maintenance est active.
+ * Elle ne se sert pas de la taille indiquée par free_sized() : un bloc découpé à l'avance peut être plus grand.
+ */
+static inline void release(void *ptr) {
+    if (__builtin_expect(maint_mode != MAINT_OFF, 0)) {
+        maint_free(ptr);
+        return;
     }
+    site_free(ptr);
+    mem_free(ptr);
 }
 
 void *malloc(size_t s) {
     void *result;
 
     init();
-    dprintf("Allocation de %lu octets...", (unsigned long) s);
-    result = mem_alloc(s);
-    if (!result)
-        dprintf(" Alloc FAILED !!");
-    else
-	dprintf(" %lx\n", (unsigned long) result);
+    maint_lock();
+    result = site_alloc(s, __builtin_return_address(0));
+    maint_unlock();
+    LOG_EVENT(LOG_MALLOC, NULL, s, result);
+    maint_op();
     return result;
 }
 
@@ -43,48 +139,133 @@ void *calloc(size_t count, size_t size) {
     size_t s = count*size;
 
     init();
-    dprintf("Allocation de %zu octets\n", s);
-    p = mem_alloc(s);
-    if (!p)
-        dprintf(" Alloc FAILED !!");
+    STATS_BEGIN();
+    maint_lock();
+    p = site_alloc(s, __builtin_return_address(0));
+    maint_unlock();
+    LOG_EVENT(LOG_CALLOC, NULL, s, p);
     if (p)
         for (i=0; i<s; i++)
             p[i] = 0;
+    STATS_END(STATS_CALLOC, s, stats_strategy());
+    maint_op();
     return p;
 }
 
 void *realloc(void *ptr, size_t size) {
-    size_t s;
+    size_t s, old_size;
     char *result;
 
     init();
-    dprintf("Reallocation de la zone en %lx\n", (unsigned long) ptr);
+    STATS_BEGIN();
+    maint_lock();
     if (!ptr) {
-        dprintf(" Realloc of NULL pointer\n");
-        return mem_alloc(size);
+        result = site_alloc(size, __builtin_return_address(0));
+        maint_unlock();
+        LOG_EVENT(LOG_REALLOC, ptr, size, result);
+        STATS_END(STATS_REALLOC, size, stats_strategy());
+        maint_op();
+        return result;
     }
-    if (mem_get_size(ptr) >= size) {
-        dprintf(" Useless realloc\n");
+    old_size = mem_get_size(ptr);
+    if (old_size >= size) {
+        maint_unlock();
+        LOG_EVENT(LOG_REALLOC, ptr, size, ptr);
+        STATS_END(STATS_REALLOC, size, stats_strategy());
         return ptr;
     }
-    result = mem_alloc(size);
+    result = site_alloc(size, __builtin_return_address(0));
+    maint_unlock();
+    LOG_EVENT(LOG_REALLOC, ptr, size, result);
     if (!result) {
-        dprintf(" Realloc FAILED\n");
+        STATS_END(STATS_REALLOC, size, stats_strategy());
         return NULL;
     }
-    for (s = 0; s<mem_get_size(ptr); s++)
+    // Les deux zones appartiennent à l'appelant : la copie se fait sans le verrou.
+    for (s = 0; s<old_size; s++)
         result[s] = ((char *) ptr)[s];
-    mem_free(ptr);
-    dprintf(" Realloc ok\n");
+    release(ptr);
+    STATS_END(STATS_REALLOC, size, stats_strategy());
+    maint_op();
     return result;
 }
 
 void free(void *ptr) {
     init();
+    LOG_EVENT(LOG_FREE, ptr, 0, NULL);
     if (ptr) {
-        dprintf("Liberation de la zone en %lx\n", (unsigned long) ptr);
-        mem_free(ptr);
-    } else {
-        dprintf("Liberation de la zone NULL\n");
+        release(ptr);
+        maint_op();
+    }
+}
+
+/* Libérations du C23 : l'appelant donne la taille demandée à l'allocation (ou au dernier realloc(), qui peut avoir gardé
+ * un bloc plus grand), que mem_free_sized() vérifie avec -DDEBUG.
+ */
+void free_sized(void *ptr, size_t size) {
+    init();
+    LOG_EVENT(LOG_FREE_SIZED, ptr, size, NULL);
+    if (ptr && __builtin_expect(maint_mode != MAINT_OFF, 0)) {
+        release(ptr);
+        maint_op();
+    } else if (ptr) {
+        site_free(ptr);
+        mem_free_sized(ptr, size);
     }
 }
+
+/* operator new et delete : mêmes chemins que malloc() et free(), le site étant donné par l'opérateur.
+ * Au delà de 16 octets, l'alignement est obtenu en réservant un bloc plus grand (mem_aligned_size(), mem_align()) ;
+ * c'est ce bloc qui est appris par hint:learn et libéré.
+ */
+void *malloc_site(size_t size, size_t alignment, void *site) {
+    void *result;
+
+    init();
+    maint_lock();
+    result = mem_align(site_alloc(mem_aligned_size(size, alignment), site), alignment);
+    maint_unlock();
+    if (__builtin_expect(log_enabled, 0))
+        log_event(LOG_NEW, NULL, size, result, site);
+    maint_op();
+    return result;
+}
+
+void free_site(void *ptr, size_t size, size_t alignment, void *site) {
+    init();
+    if (__builtin_expect(log_enabled, 0))
+        log_event(LOG_DELETE, ptr, size, NULL, site);
+    if (ptr) {
+        release(mem_aligned_block(ptr, alignment));
+        maint_op();
+    }
+}
+
+/* Allocation de n zones de size octets : retourne le nombre de zones rangées dans out.
+ * Contrairement à mem_alloc_batch(), on enchaîne les découpes jusqu'à avoir les n zones (ou échouer).
+ */
+size_t malloc_batch(size_t size, size_t n, void **out) {
+    size_t done = 0, count;
+
+    init();
+    // Comme maint_alloc() : ces zones peuvent être rendues par free(), qui y écrit le lien de la pile différée
+    if (__builtin_expect(maint_mode != MAINT_OFF, 0) && size < MAINT_MIN_SIZE)
+        size = MAINT_MIN_SIZE;
+    maint_lock();
+    while (done < n && (count = mem_alloc_batch(size, n - done, out + done)) != 0)
+        done += count;
+    maint_unlock();
+    LOG_EVENT(LOG_MALLOC_BATCH, NULL, n, done ? out[0] : NULL);
+    return done;
+}
+
+void free_batch(void **ptrs, size_t n) {
+    init();
+    LOG_EVENT(LOG_FREE_BATCH, ptrs, n, NULL);
+    maint_lock();
+    for (size_t i = 0; i < n; i++)
+        if (ptrs[i])
+            site_free(ptrs[i]);
+    mem_free_batch(ptrs, n);
+    maint_unlock();
+}
@@ -1,8 +1,31 @@
 #ifndef __MALLOC_STUB_H__
 #define __MALLOC_STUB_H__
 #include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void *malloc(size_t s);
 void *calloc(size_t count, size_t size);
 void *realloc(void *ptr, size_t size);
 void free(void *ptr);
+
+/* libération avec indication de taille (C23) ; free_aligned_sized() n'est pas fournie : aligned_alloc() ne l'étant
+ * pas non plus, ses zones ne viennent pas de l'allocateur et ne doivent pas lui être rendues */
+void free_sized(void *ptr, size_t size);
+
+/* allocations groupées, pour les programmes qui les utilisent explicitement
+ * (déclaration ci-dessus ou dlsym() si libmalloc.so est chargée par LD_PRELOAD) */
+size_t malloc_batch(size_t size, size_t n, void **out);
+void free_batch(void **ptrs, size_t n);
+
+/* points d'entrée de operator new et delete (libmallocxx.so) : comme malloc() et free(), avec un alignement, et le site
+ * d'allocation (adresse de retour de l'opérateur) pour le journal et hint:learn ; size vaut 0 si delete ne la donne pas */
+void *malloc_site(size_t size, size_t alignment, void *site);
+void free_site(void *ptr, size_t size, size_t alignment, void *site);
+
+#ifdef __cplusplus
+}
+#endif
 #endif
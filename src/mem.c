@@ -1,10 +1,13 @@
 /* On inclut l'interface publique */
 #include "mem.h"
+#include "stats.h"
 
 #include <assert.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 
 /* Définition de l'alignement recherché
  * Avec gcc, on peut utiliser __BIGGEST_ALIGNMENT__
@@ -13,9 +16,36 @@
 //#ifdef __BIGGEST_ALIGNMENT__
 //#define ALIGNMENT __BIGGEST_ALIGNMENT__
 //#else
-#define ALIGNMENT 8
+#define ALIGNMENT 16
 //#endif
 
+// Les zones données à mem_init() n'ont besoin que d'une taille (et d'une adresse) multiple de 8.
+#define ZONE_ALIGNMENT 8
+
+/* Format des métadonnées des blocs
+ * Par défaut, la taille d'un bloc est un size_t et un bloc libre pointe directement vers le bloc libre suivant.
+ * En compilant avec -DMEM_COMPACT (zones de moins de 4 Go), la taille tient sur 32 bits et le lien vers le bloc libre
+ * suivant est un décalage de 32 bits depuis le début de la zone (0 pour NULL) : l'en-tête d'un bloc occupé passe de 8 à 4 octets
+ * et les métadonnées d'un bloc libre de 16 à 8 octets sur une machine 64 bits. Les blocs restant des multiples de ALIGNMENT,
+ * un découpage ne laisse jamais de bloc libre de moins de 16 octets : le gain porte sur la taille utilisable des blocs
+ * occupés, sans multiplier les petits fragments que la recherche d'un bloc libre devrait parcourir.
+ * Les tailles étant des multiples de ALIGNMENT, leurs bits de poids faible servent d'indicateurs (BLOCK_FLAGS).
+ */
+#ifdef MEM_COMPACT
+typedef uint32_t block_size_t;
+typedef uint32_t fb_link_t;
+#else
+typedef size_t block_size_t;
+typedef struct fb *fb_link_t;
+#endif
+
+// Taille de l'en-tête d'un bloc occupé
+#define BLOCK_HEADER sizeof(block_size_t)
+
+// Bits de poids faible de l'en-tête réservés aux indicateurs, et indicateur des blocs alloués par mem_halloc()
+#define BLOCK_FLAGS ((block_size_t) (ALIGNMENT - 1))
+#define BLOCK_HANDLE ((block_size_t) 1)
+
 /* Structure placée au début de la zone de l'allocateur
 
     Elle contient toutes les variables globales nécessaires au
@@ -27,18 +57,27 @@
         - La taille de la mémoire exploitable par l'utilisateur, définie initialement dans mem_init()
     - La stratégie à utiliser lors de l'allocation de la mémoire (pointeur vers une fonction)
     - Un pointeur vers le premier bloc libre
+    - La table des poignées (mem_halloc()) et son nombre d'entrées, NULL tant qu'aucune poignée n'a été demandée
+    - Le moteur gérant la zone (liste de blocs libres ou système binaire de compagnons)
+    - Le bloc libre après lequel mem_compact() reprend son parcours (NULL : depuis le début de la liste), remis à NULL
+      par toute modification de la liste des blocs libres, qui pourrait le faire disparaître
 */
 struct allocator_header {
     size_t memory_size;
     mem_fit_function_t *fit;
     struct fb *list;
+    struct handle *handles;
+    size_t handles_count;
+    enum mem_engine engine;
+    struct fb *compact_resume;
 };
 
-/* La seule variable globale autorisée
- * On trouve à cette adresse le début de la zone à gérer
- * (et une structure 'struct allocator_header')
+/* La seule variable globale autorisée, propre à chaque thread
+ * On trouve à cette adresse le début de la zone que gère le thread (et une structure 'struct allocator_header') :
+ * des threads opérant sur des zones différentes ne se gênent donc pas.
+ * Le modèle initial-exec évite un appel à __tls_get_addr() à chaque accès depuis libmalloc.so, chargée au démarrage.
  */
-static void* memory_addr;
+static __thread void* memory_addr __attribute__((tls_model("initial-exec")));
 
 // Retourne le pointeur du début de l'allocateur (struct allocator_header) (et également le champ memory_size de ce dernier).
 static inline void *get_system_memory_addr() {
@@ -62,18 +101,510 @@ static inline size_t get_system_memory_size() {
  * Un bloc libre a une taille allouable (size) et un pointeur vers le prochain bloc libre.
  */
 struct fb {
-    size_t size;
-    struct fb* next;
+    block_size_t size;
+    fb_link_t next;
+};
+
+// Retourne le bloc libre suivant fb (NULL s'il n'y en a pas).
+static inline struct fb *fb_next(struct fb *fb) {
+#ifdef MEM_COMPACT
+    return fb->next != 0 ? get_system_memory_addr() + fb->next : NULL;
+#else
+    return fb->next;
+#endif
+}
+
+// Fait de next le bloc libre suivant fb.
+static inline void fb_set_next(struct fb *fb, struct fb *next) {
+#ifdef MEM_COMPACT
+    fb->next = next != NULL ? (uint32_t) ((void*)next - get_system_memory_addr()) : 0;
+#else
+    fb->next = next;
+#endif
+}
+
+// Crée un bloc libre de taille size à l'adresse fb, suivi du bloc libre next.
+static inline void fb_init(struct fb *fb, size_t size, struct fb *next) {
+    fb->size = size;
+    fb_set_next(fb, next);
+}
+
+// Retourne la taille (métadonnées comprises, sans les indicateurs) du bloc dont l'en-tête est à l'adresse block.
+static inline size_t get_block_header(void *block) {
+    return *(block_size_t*)block & ~BLOCK_FLAGS;
+}
+
+/* Position du premier bloc dans la zone mem : juste après la structure allocator_header, décalée pour que l'adresse
+ * retournée à l'utilisateur (après l'en-tête du bloc) soit alignée sur ALIGNMENT. La zone n'étant alignée que sur
+ * ZONE_ALIGNMENT, le décalage dépend de son adresse.
+ */
+static inline size_t first_block_offset(void *mem) {
+    uintptr_t data = ((uintptr_t) mem + sizeof(struct allocator_header) + BLOCK_HEADER + ALIGNMENT - 1) & ~(uintptr_t) (ALIGNMENT - 1);
+    
+    return data - BLOCK_HEADER - (uintptr_t) mem;
+}
+
+// Retourne l'adresse du premier bloc (libre ou occupé) de l'allocateur.
+static inline void *get_first_block() {
+    return get_system_memory_addr() + first_block_offset(get_system_memory_addr());
+}
+
+// Retourne l'adresse de fin des blocs : la taille des blocs étant un multiple de ALIGNMENT, quelques octets peuvent rester inutilisés.
+static inline void *get_blocks_end() {
+    size_t offset = first_block_offset(get_system_memory_addr());
+    
+    return get_system_memory_addr() + offset + ((get_system_memory_size() - offset) & ~(size_t) (ALIGNMENT - 1));
+}
+
+
+/* Structure représentant une entrée de la table des poignées.
+ * block pointe vers l'en-tête du bloc occupé (NULL si l'entrée est inutilisée),
+ * locks compte les mem_hlock() en cours : le bloc ne peut être déplacé par mem_compact() que s'il vaut 0.
+ */
+struct handle {
+    void *block;
+    size_t locks;
+};
+
+
+/* Système binaire de compagnons (moteur MEM_ENGINE_BUDDY)
+ *
+ * La zone suivant la structure allocator_header contient une structure buddy_header, une table de bits, une table des ordres,
+ * puis les blocs.
+ * Un bloc d'ordre k mesure 2^k octets et se trouve à un décalage multiple de 2^k depuis base :
+ * son compagnon est donc à l'adresse base + (décalage XOR 2^k), et les deux fusionnent en un bloc d'ordre k + 1.
+ * La partie gérée est découpée au départ en blocs de tailles décroissantes (décomposition binaire de sa longueur).
+ *
+ * Les blocs libres de chaque ordre forment une liste doublement chaînée, pour pouvoir en retirer un compagnon en O(1).
+ * La table de bits est un arbre binaire complet (un niveau par ordre) : le bit d'un couple (ordre, décalage) indique
+ * qu'un bloc libre de cet ordre commence à ce décalage.
+ * Un bloc occupé n'a pas d'en-tête : son ordre est inscrit dans la table des ordres (un octet par bloc de taille minimale),
+ * ce qui laisse tout le bloc à l'utilisateur. Un tampon de 2^k octets occupe ainsi exactement un bloc d'ordre k.
+ */
+
+// Ordre du plus petit bloc : il doit pouvoir contenir une structure buddy_fb
+#define BUDDY_MIN_ORDER 5
+#define BUDDY_ORDERS (8 * sizeof(size_t))
+
+// Nombre de bits d'un mot de la table de bits
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+
+struct buddy_fb {
+    size_t order;
+    struct buddy_fb *next;
+    struct buddy_fb *prev;
+};
+
+/* Métadonnées du système de compagnons
+ * max_order est l'ordre du plus grand bloc possible (2^max_order >= length),
+ * free_lists contient une liste par ordre de BUDDY_MIN_ORDER à max_order.
+ */
+struct buddy_header {
+    void *base;
+    size_t length;
+    size_t max_order;
+    unsigned long *bitmap;
+    unsigned char *orders;
+    struct buddy_fb *free_lists[];
+};
+
+// Retourne la structure buddy_header, placée juste après la structure allocator_header.
+static inline struct buddy_header *get_buddy() {
+    return get_system_memory_addr() + sizeof(struct allocator_header);
+}
+
+// Retourne le plus petit ordre k tel que 2^k >= size (au moins BUDDY_MIN_ORDER, BUDDY_ORDERS si aucun ne convient).
+static inline size_t buddy_order(size_t size) {
+    size_t k = BUDDY_MIN_ORDER;
+    
+    while (k < BUDDY_ORDERS && ((size_t) 1 << k) < size)
+        k++;
+    
+    return k;
+}
+
+// Retourne l'ordre du bloc occupé dont les données sont à l'adresse mem.
+static inline size_t buddy_block_order(void *mem) {
+    return get_buddy()->orders[(mem - get_buddy()->base) >> BUDDY_MIN_ORDER];
+}
+
+// Retourne la liste des blocs libres d'ordre k.
+static inline struct buddy_fb **buddy_list(size_t k) {
+    return &get_buddy()->free_lists[k - BUDDY_MIN_ORDER];
+}
+
+// Retourne la position dans l'arbre de bits du bloc d'ordre k situé au décalage offset.
+static inline size_t buddy_bit(size_t k, size_t offset) {
+    return ((size_t) 1 << (get_buddy()->max_order - k)) - 1 + (offset >> k);
+}
+
+// Accès au bit indiquant si un bloc libre d'ordre k commence au décalage offset.
+static inline int buddy_is_free(size_t k, size_t offset) {
+    size_t i = buddy_bit(k, offset);
+    return (get_buddy()->bitmap[i / BITS_PER_WORD] >> (i % BITS_PER_WORD)) & 1;
+}
+
+static inline void buddy_set_free(size_t k, size_t offset, int free) {
+    size_t i = buddy_bit(k, offset);
+    unsigned long mask = 1UL << (i % BITS_PER_WORD);
+    
+    if (free)
+        get_buddy()->bitmap[i / BITS_PER_WORD] |= mask;
+    else
+        get_buddy()->bitmap[i / BITS_PER_WORD] &= ~mask;
+}
+
+// Ajoute le bloc libre d'ordre k situé au décalage offset en tête de la liste de son ordre.
+static void buddy_push(size_t k, size_t offset) {
+    struct buddy_fb **list = buddy_list(k);
+    struct buddy_fb *block = get_buddy()->base + offset;
+    
+    *block = (struct buddy_fb) { k, *list, NULL };
+    if (*list != NULL)
+        (*list)->prev = block;
+    *list = block;
+    buddy_set_free(k, offset, 1);
+}
+
+// Retire le bloc libre block (d'ordre k) de la liste de son ordre.
+static void buddy_remove(size_t k, struct buddy_fb *block) {
+    if (block->prev != NULL)
+        block->prev->next = block->next;
+    else
+        *buddy_list(k) = block->next;
+    if (block->next != NULL)
+        block->next->prev = block->prev;
+    buddy_set_free(k, (void*)block - get_buddy()->base, 0);
+}
+
+// Initialisation du moteur : listes et table de bits, puis découpage de la partie gérée en blocs libres.
+static void buddy_init(size_t taille) {
+    struct buddy_header *b = get_buddy();
+    void *end = get_system_memory_addr() + taille;
+    size_t k;
+    
+    // Les métadonnées sont dimensionnées d'après la taille de la zone, la partie gérée étant forcément plus petite.
+    b->max_order = buddy_order(taille);
+    for (k = BUDDY_MIN_ORDER; k <= b->max_order; k++)
+        *buddy_list(k) = NULL;
+    
+    size_t bits = ((size_t) 2 << (b->max_order - BUDDY_MIN_ORDER)) - 1;
+    size_t words = (bits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    
+    b->bitmap = (void*)buddy_list(b->max_order + 1);
+    memset(b->bitmap, 0, words * sizeof(unsigned long));
+    b->orders = (void*)(b->bitmap + words);
+    
+    // Les blocs commencent après la table des ordres, à une adresse multiple de la taille minimale d'un bloc.
+    size_t min_size = (size_t) 1 << BUDDY_MIN_ORDER;
+    b->base = (void*)(((uintptr_t) (b->orders + (taille >> BUDDY_MIN_ORDER)) + min_size - 1) & ~(uintptr_t) (min_size - 1));
+    b->length = b->base < end ? (size_t) (end - b->base) & ~(min_size - 1) : 0;
+    
+    // Décomposition binaire : chaque bloc se trouve à un décalage multiple de sa taille, puisque les précédents sont plus grands.
+    size_t offset = 0;
+    while (b->length - offset >= ((size_t) 1 << BUDDY_MIN_ORDER)) {
+        for (k = b->max_order; ((size_t) 1 << k) > b->length - offset; k--)
+            ;
+        buddy_push(k, offset);
+        offset += (size_t) 1 << k;
+    }
+}
+
+static void *buddy_alloc(size_t taille) {
+    struct buddy_header *b = get_buddy();
+    size_t k = buddy_order(taille), j;
+    
+    // On cherche le plus petit ordre disposant d'un bloc libre.
+    for (j = k; j <= b->max_order && *buddy_list(j) == NULL; j++)
+        ;
+    if (j > b->max_order)
+        return NULL;
+    
+    struct buddy_fb *block = *buddy_list(j);
+    size_t offset = (void*)block - b->base;
+    buddy_remove(j, block);
+    
+    // On coupe le bloc en deux jusqu'à atteindre l'ordre demandé, en rendant à chaque fois la moitié haute.
+    while (j > k) {
+        j--;
+        buddy_push(j, offset + ((size_t) 1 << j));
+    }
+    
+    b->orders[offset >> BUDDY_MIN_ORDER] = k;
+    
+    return block;
+}
+
+// Libère le bloc d'ordre k dont les données sont à l'adresse mem, en le fusionnant tant que son compagnon est libre.
+static void buddy_free(void *mem, size_t k) {
+    struct buddy_header *b = get_buddy();
+    size_t offset = mem - b->base;
+    
+    while (k < b->max_order) {
+        size_t buddy = offset ^ ((size_t) 1 << k), merged = offset & ~((size_t) 1 << k);
+        
+        // Le bloc fusionné doit rester dans la partie gérée (cas des derniers blocs de la décomposition initiale).
+        if (merged + ((size_t) 2 << k) > b->length || !buddy_is_free(k, buddy))
+            break;
+        
+        buddy_remove(k, b->base + buddy);
+        offset = merged;
+        k++;
+    }
+    
+    buddy_push(k, offset);
+}
+
+// Parcours des blocs par adresses croissantes pour mem_show().
+static void buddy_show(void (*print)(void *, size_t, int)) {
+    struct buddy_header *b = get_buddy();
+    size_t offset = 0;
+    
+    while (offset < b->length) {
+        size_t k, size = 0;
+        
+        // Un bloc libre est repéré par le bit de son ordre, l'ordre d'un bloc occupé est dans la table des ordres.
+        for (k = BUDDY_MIN_ORDER; k <= b->max_order && offset % ((size_t) 1 << k) == 0; k++)
+            if (buddy_is_free(k, offset))
+                size = (size_t) 1 << k;
+        
+        if (size != 0)
+            print(b->base + offset, size, 1);
+        else {
+            size = (size_t) 1 << b->orders[offset >> BUDDY_MIN_ORDER];
+            print(b->base + offset, size, 0);
+        }
+        
+        offset += size;
+    }
+}
+
+
+/* Métadonnées hors des blocs (moteur MEM_ENGINE_BITMAP)
+ *
+ * La partie gérée est découpée en granules de BITMAP_GRANULE octets, regroupés par tranches de 64 granules.
+ * Chaque tranche a deux mots de 64 bits, un bit par granule : start indique le début d'un bloc occupé,
+ * free les granules libres. Une suite de granules libres forme un bloc libre, la fusion est donc implicite.
+ * Il n'y a pas de table des tailles : un bloc occupé s'arrête au prochain granule dont le bit start ou free est mis,
+ * trouvé le plus souvent dans le même mot. Les métadonnées coûtent ainsi 2 bits par granule de 16 octets (1,6 % de la zone).
+ *
+ * Ces tables, placées après la structure allocator_header, sont les seules données lues ou écrites par l'allocateur :
+ * les blocs n'ont aucun en-tête, si bien que mem_free(), mem_get_size() et mem_show() ne touchent jamais la mémoire de
+ * l'utilisateur, et qu'un débordement de celle-ci ne peut pas corrompre les métadonnées.
+ */
+
+// Taille d'un granule, qui est aussi l'alignement des zones retournées
+#define BITMAP_GRANULE_ORDER 4
+#define BITMAP_GRANULE ((size_t) 1 << BITMAP_GRANULE_ORDER)
+
+struct bitmap_chunk {
+    uint64_t start;
+    uint64_t free;
 };
 
+struct bitmap_header {
+    void *base;
+    size_t granules;
+    size_t chunks_count;
+    struct bitmap_chunk *chunks;
+};
+
+// Retourne la structure bitmap_header, placée juste après la structure allocator_header.
+static inline struct bitmap_header *get_bitmap() {
+    return get_system_memory_addr() + sizeof(struct allocator_header);
+}
+
+// Nombre de granules nécessaires pour taille octets (au moins un).
+static inline size_t bitmap_granules(size_t taille) {
+    return taille == 0 ? 1 : (taille + BITMAP_GRANULE - 1) >> BITMAP_GRANULE_ORDER;
+}
+
+/* Retourne le premier granule g' >= g dont le bit free vaut free (b->granules s'il n'y en a pas).
+ * Les granules qui suivent le dernier, dans la dernière tranche, ne sont jamais libres.
+ */
+static size_t bitmap_find(size_t g, int free) {
+    struct bitmap_header *b = get_bitmap();
+    uint64_t flip = free ? 0 : ~(uint64_t) 0;
+    size_t c = g / 64;
+    
+    if (g >= b->granules)
+        return b->granules;
+    
+    uint64_t word = (b->chunks[c].free ^ flip) & (~(uint64_t) 0 << (g % 64));
+    while (word == 0) {
+        STATS_VISIT();
+        if (++c == b->chunks_count)
+            return b->granules;
+        word = b->chunks[c].free ^ flip;
+    }
+    
+    g = c * 64 + __builtin_ctzll(word);
+    return g < b->granules ? g : b->granules;
+}
+
+// Retourne le nombre de granules du bloc occupé commençant au granule g : il s'arrête au prochain début de bloc ou granule libre.
+static size_t bitmap_block_granules(size_t g) {
+    struct bitmap_header *b = get_bitmap();
+    size_t c = (g + 1) / 64;
+    uint64_t word = 0;
+    
+    if (c < b->chunks_count)
+        word = (b->chunks[c].start | b->chunks[c].free) & (~(uint64_t) 0 << ((g + 1) % 64));
+    while (word == 0 && ++c < b->chunks_count)
+        word = b->chunks[c].start | b->chunks[c].free;
+    
+    size_t end = word != 0 ? c * 64 + __builtin_ctzll(word) : b->granules;
+    return (end < b->granules ? end : b->granules) - g;
+}
+
+// Donne la valeur free aux bits free des n granules à partir de g.
+static void bitmap_set_free(size_t g, size_t n, int free) {
+    struct bitmap_header *b = get_bitmap();
+    
+    while (n > 0) {
+        size_t bit = g % 64, count = 64 - bit < n ? 64 - bit : n;
+        uint64_t mask = (count == 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << count) - 1)) << bit;
+        
+        if (free)
+            b->chunks[g / 64].free |= mask;
+        else
+            b->chunks[g / 64].free &= ~mask;
+        g += count;
+        n -= count;
+    }
+}
+
+// Initialisation du moteur : tables dimensionnées d'après la taille de la zone, tous les granules gérés sont libres.
+static void bitmap_init(size_t taille) {
+    struct bitmap_header *b = get_bitmap();
+    void *end = get_system_memory_addr() + taille;
+    size_t granules = taille >> BITMAP_GRANULE_ORDER;
+    
+    b->chunks_count = (granules + 63) / 64;
+    b->chunks = (void*)(((uintptr_t) (b + 1) + 7) & ~(uintptr_t) 7);
+    memset(b->chunks, 0, b->chunks_count * sizeof(struct bitmap_chunk));
+    b->base = (void*)(((uintptr_t) (b->chunks + b->chunks_count) + BITMAP_GRANULE - 1) & ~(uintptr_t) (BITMAP_GRANULE - 1));
+    b->granules = b->base < end ? (size_t) (end - b->base) >> BITMAP_GRANULE_ORDER : 0;
+    
+    bitmap_set_free(0, b->granules, 1);
+}
+
+// Première suite de granules libres assez longue (first fit), en ne lisant que les mots free des tranches.
+static void *bitmap_alloc(size_t taille) {
+    struct bitmap_header *b = get_bitmap();
+    size_t n, g;
+    
+    // Le calcul du nombre de granules déborderait pour une taille proche de SIZE_MAX, qui ne peut de toute façon pas être servie.
+    if (taille > b->granules << BITMAP_GRANULE_ORDER)
+        return NULL;
+    
+    n = bitmap_granules(taille);
+    g = bitmap_find(0, 1);
+    
+    while (g < b->granules) {
+        size_t end = bitmap_find(g, 0);
+        
+        if (end - g >= n) {
+            bitmap_set_free(g, n, 0);
+            b->chunks[g / 64].start |= (uint64_t) 1 << (g % 64);
+            return b->base + (g << BITMAP_GRANULE_ORDER);
+        }
+        
+        g = bitmap_find(end, 1);
+    }
+    
+    return NULL;
+}
+
+// Libère le bloc de n granules dont les données sont à l'adresse mem.
+static void bitmap_free(void *mem, size_t n) {
+    struct bitmap_header *b = get_bitmap();
+    size_t g = (mem - b->base) >> BITMAP_GRANULE_ORDER;
+    
+    assert((b->chunks[g / 64].start >> (g % 64)) & 1);
+    b->chunks[g / 64].start &= ~((uint64_t) 1 << (g % 64));
+    bitmap_set_free(g, n, 1);
+}
+
+// Retourne le nombre de granules du bloc occupé dont les données sont à l'adresse mem.
+static inline size_t bitmap_block_size(void *mem) {
+    return bitmap_block_granules((mem - get_bitmap()->base) >> BITMAP_GRANULE_ORDER);
+}
+
+/* Parcours des blocs pour mem_show(), une tranche à la fois : les débuts de blocs d'une tranche sont ses bits start
+ * et les premiers granules de ses suites libres (bit free mis, celui du granule précédent non). Chaque bloc est affiché
+ * quand on trouve le début du suivant ; le granule 0 commence toujours le premier bloc.
+ */
+static void bitmap_show(void (*print)(void *, size_t, int)) {
+    struct bitmap_header *b = get_bitmap();
+    size_t first = 0;
+    int first_free = b->chunks_count > 0 && (b->chunks[0].free & 1);
+    uint64_t carry = 0;
+    
+    for (size_t c = 0; c < b->chunks_count; c++) {
+        uint64_t free = b->chunks[c].free;
+        uint64_t starts = (b->chunks[c].start | (free & ~((free << 1) | carry))) & ~(c == 0 ? (uint64_t) 1 : 0);
+        
+        carry = free >> 63;
+        while (starts != 0) {
+            size_t g = c * 64 + __builtin_ctzll(starts);
+            
+            print(b->base + (first << BITMAP_GRANULE_ORDER), (g - first) << BITMAP_GRANULE_ORDER, first_free);
+            first = g;
+            first_free = (free >> (g % 64)) & 1;
+            starts &= starts - 1;
+        }
+    }
+    
+    if (first < b->granules)
+        print(b->base + (first << BITMAP_GRANULE_ORDER), (b->granules - first) << BITMAP_GRANULE_ORDER, first_free);
+}
+
 
 /* Fonction permettant d'initialiser l'allocateur avec une taille initiale et un pointeur vers la zone à utiliser.
  * Cette zone devra avoir été préalablement allouée par l'utilisateur, et la taille demandée ne peut pas être supérieure
  * à la taille de la zone allouée.
  */
 void mem_init(void* mem, size_t taille) {
-    // Il faut que taille demandée soit un multiple de ALIGNMENT et qu'il soit supérieur à celui-ci afin d'optimiser l'allocation de la mémoire.
-    if (taille < (size_t) ALIGNMENT || taille % (size_t) ALIGNMENT != 0)
+    mem_init_engine(mem, taille, MEM_ENGINE_LIST);
+}
+
+/* Comme mem_init(), en choisissant le moteur qui gérera la zone : la liste de blocs libres ordonnée par adresses,
+ * dont la stratégie se choisit avec mem_fit(), le système binaire de compagnons, ou les tables de bits hors des blocs.
+ */
+/* Taille minimale d'une zone de taille octets gérée par le moteur engine : ses métadonnées, le décalage d'alignement
+ * du premier bloc dans le pire cas et au moins un bloc (mêmes calculs que buddy_init() et bitmap_init()).
+ */
+static size_t engine_min_size(size_t taille, enum mem_engine engine) {
+    if (engine == MEM_ENGINE_BUDDY) {
+        size_t max_order = buddy_order(taille);
+        size_t bits = ((size_t) 2 << (max_order - BUDDY_MIN_ORDER)) - 1;
+        size_t words = (bits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+        return sizeof(struct allocator_header) + sizeof(struct buddy_header)
+            + (max_order - BUDDY_MIN_ORDER + 1) * sizeof(struct buddy_fb*) + words * sizeof(unsigned long)
+            + (taille >> BUDDY_MIN_ORDER) + 2 * ((size_t) 1 << BUDDY_MIN_ORDER) - 1;
+    } else if (engine == MEM_ENGINE_BITMAP) {
+        size_t chunks = ((taille >> BITMAP_GRANULE_ORDER) + 63) / 64;
+        return sizeof(struct allocator_header) + sizeof(struct bitmap_header) + 7
+            + chunks * sizeof(struct bitmap_chunk) + 2 * BITMAP_GRANULE - 1;
+    }
+    // Décalage du premier bloc dans le pire cas, puis un bloc, d'au moins ALIGNMENT octets (sizeof(struct fb) <= ALIGNMENT).
+    return sizeof(struct allocator_header) + ALIGNMENT - 1 + ALIGNMENT;
+}
+
+void mem_init_engine(void* mem, size_t taille, enum mem_engine engine) {
+    // Il faut que taille demandée soit un multiple de ZONE_ALIGNMENT et qu'elle soit supérieure à celui-ci.
+    if (taille < (size_t) ZONE_ALIGNMENT || taille % (size_t) ZONE_ALIGNMENT != 0)
+        return;
+
+#ifdef MEM_COMPACT
+    // Les tailles et les décalages doivent tenir sur 32 bits.
+    if (taille > UINT32_MAX)
+        return;
+#endif
+    
+    // La zone doit pouvoir contenir les métadonnées du moteur et au moins un bloc : rien n'est écrit sinon.
+    if (taille < engine_min_size(taille, engine))
         return;
     
     // On définit la variable globale memory_addr par la valeur du pointeur renseigné par l'utilisateur.
@@ -85,15 +616,27 @@ void mem_init(void* mem, size_t taille) {
     assert(mem == get_system_memory_addr());
     assert(taille == get_system_memory_size());
     
-    /* On fait pointer la variable list des métadonnées globales (premier bloc libre de l'allocateur)
-     * vers l'adresse se situant juste après la structure allocator_header.
-     */
-    get_header()->list = get_system_memory_addr() + sizeof(struct allocator_header);
-    // On crée une structure de bloc libre à cette adresse, de taille maximale afin de remplir tout l'espace demandé par l'utilisateur.
-    *(get_header()->list) = (struct fb) {
-        taille - sizeof(struct allocator_header),
-        NULL
-    };
+    get_header()->engine = engine;
+    
+    if (engine == MEM_ENGINE_BUDDY) {
+        get_header()->list = NULL;
+        buddy_init(taille);
+    } else if (engine == MEM_ENGINE_BITMAP) {
+        get_header()->list = NULL;
+        bitmap_init(taille);
+    } else {
+        /* On fait pointer la variable list des métadonnées globales (premier bloc libre de l'allocateur)
+         * vers l'adresse se situant juste après la structure allocator_header.
+         */
+        get_header()->list = get_first_block();
+        // On crée une structure de bloc libre à cette adresse, de taille maximale afin de remplir tout l'espace demandé par l'utilisateur.
+        fb_init(get_header()->list, get_blocks_end() - get_first_block(), NULL);
+    }
+    
+    // Aucune poignée n'a encore été allouée.
+    get_header()->handles = NULL;
+    get_header()->handles_count = 0;
+    get_header()->compact_resume = NULL;
     
     // On définit la stratégie d'allocation par mem_fit_first().
     mem_fit(&mem_fit_first);
@@ -101,22 +644,31 @@ void mem_init(void* mem, size_t taille) {
 
 // Cette fonction permet d'afficher dans le shell une représentation textuelle des blocs mémoire utilisés par l'allocateur.
 void mem_show(void (*print)(void *, size_t, int)) {
+    if (get_header()->engine == MEM_ENGINE_BUDDY) {
+        buddy_show(print);
+        return;
+    }
+    if (get_header()->engine == MEM_ENGINE_BITMAP) {
+        bitmap_show(print);
+        return;
+    }
+    
     // On crée un pointeur vers le premier bloc (libre ou occupé) de l'allocateur.
-    void *current = get_system_memory_addr() + sizeof(struct allocator_header);
+    void *current = get_first_block();
     // On crée un pointeur vers le premier bloc libre de l'allocateur.
     struct fb *free_block = get_header()->list;
     
     /* Boucle permettant de parcourir tous les blocs mémoire de l'allocateur.
      * Elle s'arrêtera lorsque la variable current pointera vers une adresse en dehors de l'allocateur.
      */
-    while (current < get_system_memory_addr() + get_system_memory_size()) {
+    while (current < get_blocks_end()) {
         /* Entier (booléen) valant 1 si le bloc actuel (current) est un bloc libre
          * (s'il est à la même adresse que le bloc libre actuel : free_block).
          * Vaut 0 sinon.
          */
         int is_free = current == (void*)free_block ? 1 : 0;
         // Variable contenant la taille du boc actuel
-        size_t size = *(size_t*)current;
+        size_t size = get_block_header(current);
         /* Cette instruction permet d'afficher une représentation textuelle du bloc actuelle, indiquant son adresse
          * en mémoire, sa taille et s'il est libre ou non.
          * Pour ce faire, on utilise le pointeur de la fonction passée en paramètre de mem_show().
@@ -127,13 +679,45 @@ void mem_show(void (*print)(void *, size_t, int)) {
         
         // Si le bloc actuel est libre, on renseigne dans free_block le prochain bloc libre.
         if (is_free == 1)
-            free_block = free_block->next;
+            free_block = fb_next(free_block);
         
         // Finalement, on fait pointer current vers le prochain bloc, en lui ajoutant la taille du bloc actuel.
         current += size;
     }
 }
 
+#ifdef MEM_STATS
+enum stats_strategy stats_strategy() {
+    mem_fit_function_t *fit = get_header()->fit;
+
+    if (get_header()->engine == MEM_ENGINE_BUDDY)
+        return STATS_BUDDY;
+    if (get_header()->engine == MEM_ENGINE_BITMAP)
+        return STATS_BITMAP;
+    if (fit == &mem_fit_first)
+        return STATS_FIRST;
+    if (fit == &mem_fit_best)
+        return STATS_BEST;
+    if (fit == &mem_fit_worst)
+        return STATS_WORST;
+    return STATS_OTHER;
+}
+#endif
+
+/* Changement de zone : toutes les métadonnées d'une zone se trouvent dans celle-ci, il suffit donc de changer memory_addr.
+ * Cela permet de gérer plusieurs zones (une par std::pmr::memory_resource par exemple), une seule à la fois par thread.
+ */
+void *mem_use(void *mem) {
+    void *previous = memory_addr;
+    
+    memory_addr = mem;
+    return previous;
+}
+
+void *mem_current() {
+    return memory_addr;
+}
+
 // Fonction permettant de redéfinir la stratégie d'allocation par celle passée en paramètre (pointeur vers une fonction).
 void mem_fit(mem_fit_function_t *f) {
     get_header()->fit = f;
@@ -153,7 +737,13 @@ size_t mem_get_size(void *zone) {
 
     /* la valeur retournée doit être la taille maximale que
      * l'utilisateur peut utiliser dans cette zone */
-    return *(size_t*) (zone - sizeof(size_t));
+    if (get_header()->engine == MEM_ENGINE_BUDDY)
+        return (size_t) 1 << buddy_block_order(zone);
+    if (get_header()->engine == MEM_ENGINE_BITMAP)
+        return bitmap_block_size(zone) << BITMAP_GRANULE_ORDER;
+    
+    // L'en-tête contient la taille du bloc, métadonnées comprises.
+    return get_block_header(zone - BLOCK_HEADER) - BLOCK_HEADER;
 }
 
 
@@ -172,6 +762,30 @@ size_t mem_get_size(void *zone) {
  * tant que ce dépassement n'est pas supérieur à memory_gap
  */
 
+/* Fonction retournant la taille totale (métadonnées comprises) du bloc occupé qui sera réservé pour une demande de taille octets.
+ * Le bloc peut être un peu plus grand si le reste du bloc libre où il est découpé est trop petit pour un bloc libre.
+ */
+static inline size_t get_block_size(size_t taille) {
+    /* Une demande plus grande que la zone ne peut pas être servie : on retourne une taille qu'aucun bloc n'atteint,
+     * sans calculer taille + BLOCK_HEADER, qui peut déborder.
+     */
+    if (taille > get_system_memory_size())
+        return get_system_memory_size() + ALIGNMENT;
+
+    //taille des meta données et bloc utilisateur
+    size_t taille_total = taille + BLOCK_HEADER;
+
+    //on vérifie que le bloc occupé aura au moins la taille pour les meta données du bloc libre
+    if (taille_total < sizeof(struct fb))
+        taille_total = sizeof(struct fb);
+
+    //On vérifie l'alignement pour la taille du bloc (ce qui garantit celui de la zone de l'utilisateur qui suit l'en-tête)
+    if (taille_total % ALIGNMENT != 0)
+        taille_total += (ALIGNMENT - taille_total % ALIGNMENT);
+
+    return taille_total;
+}
+
 void *mem_alloc(size_t taille) {
     /* INSTRUCTIONS :
      * L'appel de get_header()->fit(get_header()->list, taille) (ligne 168) va retourner une zone libre selon la stratégie utilisée, que l'on stockera dans *fb
@@ -181,84 +795,142 @@ void *mem_alloc(size_t taille) {
      * s'il reste assez de place pour stocker les métadonnées de cette nouvelle zone, et un minimum de place supplémentaire
      * Finalement, on retournera le pointeur vers la zone mémoire de l'utilisateur, c'est à dire (void*)(fb + sizeof(size_t))
      */
-    
-    //on vérifie que le bloc occupé aura au moins la taille pour les meta données du bloc libre
-    if ((sizeof(size_t) + taille) < sizeof(struct fb))
-        taille = sizeof(struct fb) - sizeof(size_t);
-    
-    //On vérifie l'alignement pour la taille demandé
-    if (taille % ALIGNMENT != 0)
-        taille += (ALIGNMENT - taille % ALIGNMENT);
-    
+
+    STATS_BEGIN();
+
+    if (get_header()->engine == MEM_ENGINE_BUDDY) {
+        void *result = buddy_alloc(taille);
+        STATS_END(STATS_ALLOC, result != NULL ? mem_get_size(result) : taille, STATS_BUDDY);
+        return result;
+    }
+    if (get_header()->engine == MEM_ENGINE_BITMAP) {
+        void *result = bitmap_alloc(taille);
+        STATS_END(STATS_ALLOC, result != NULL ? mem_get_size(result) : taille, STATS_BITMAP);
+        return result;
+    }
+
     //taille des meta données et bloc utilisateur
-    size_t taille_total = taille + sizeof(size_t);
-    
+    size_t taille_total = get_block_size(taille);
+
     __attribute__((unused)) /* juste pour que gcc compile ce squelette avec -Werror */
     struct fb *fb=get_header()->fit(get_header()->list, taille_total);
     
     //on vérifie qu'on a bien trouvé un bloc disponible
-    if (fb == NULL)
+    if (fb == NULL) {
+        STATS_END(STATS_ALLOC, taille, stats_strategy());
         return NULL;
+    }
     
-    //On cherche le bloc libre précédent le bloc libre trouvé
-    struct fb *current = get_header()->list;
-    while (current != NULL && current->next < fb)
-        current = current->next;
-
-    // S'il n'y a pas de bloc libre précédent fb, alors on fait pointer current sur NULL
-    if (current > fb)
-    	current = NULL;
+    /* Si le résidu laissé dans fb ne peut pas contenir les métadonnées d'un bloc libre, on donne tout le bloc :
+     * l'en-tête garde sa taille réelle, que lisent mem_free() et mem_free_sized().
+     */
+    if (fb->size - taille_total < sizeof(struct fb))
+        taille_total = fb->size;
     
-    if (current != NULL && taille_total == fb->size) {
-        current->next = fb->next;
-        if (fb == get_header()->list)
-    		get_header()->list = fb->next;
+    //On cherche le bloc libre précédent le bloc libre trouvé (NULL si fb est le premier bloc libre)
+    struct fb *before = NULL, *current = get_header()->list;
+    while (current != fb) {
+        STATS_VISIT();
+        before = current;
+        current = fb_next(current);
     }
-    else {
+    
+    // Bloc libre qui remplacera fb dans la liste : le résidu de fb s'il y en a un, le bloc libre suivant sinon.
+    struct fb *next = fb_next(fb);
+    
+    if (taille_total != fb->size) {
         //on définit le nouveau bloc libre suivant le bloc à allouer
         struct fb *after = (void*)fb + taille_total;
-        *after = (struct fb){
-            fb->size - taille_total,
-            fb->next
-        };
+        fb_init(after, fb->size - taille_total, next);
         fb->size = taille_total;
-
-        if (current != NULL)
-	        current->next = after;
-
-	    if (fb == get_header()->list)
-    		get_header()->list = after;
+        next = after;
     }
     
-    void* res = (void*)fb + sizeof(size_t);
+    if (before != NULL)
+        fb_set_next(before, next);
+    else
+        get_header()->list = next;
+    get_header()->compact_resume = NULL;
     
+    void* res = (void*)fb + BLOCK_HEADER;
+    
+    STATS_END(STATS_ALLOC, taille_total - BLOCK_HEADER, stats_strategy());
     return res;
 }
 
 
-/* Fonction permettant de libérer une zone allouée par l'utilisateur.
- * Le paramètre mem est le pointeur retourné à l'utilisateur lors du mem_alloc().
- * Ce dernier pointe vers l'adresse correspondant au début de la zone mémoire demandée préalablement par l'utilisateur.
+/* Allocation avec indication de durée de vie.
+ * Les zones de courte durée (ou sans indication) sont allouées normalement par mem_alloc(), donc vers le début de la zone
+ * avec les stratégies usuelles. Les zones de longue durée sont découpées à la fin du dernier bloc libre assez grand :
+ * elles s'accumulent ainsi en fin de zone et n'empêchent plus la fusion des blocs libérés entre les zones de courte durée.
+ * Il faut pour cela parcourir toute la liste des blocs libres, comme pour mem_fit_best() et mem_fit_worst().
+ * Le système de compagnons et les tables de bits ne tiennent pas compte de l'indication.
  */
-void mem_free(void* mem) {
-    /* On initialise des pointeurs de structures de bloc libre qui correspondront au bloc que l'utilisateur demande de libérer,
-     * puis au blocs libres précédant et suivant ce dernier, afin de savoir s'il faut réassembler les-dits blocs.
-     */
-    struct fb *before = NULL, *current = (struct fb*)(mem - sizeof(size_t)), *after = get_header()->list;
+void *mem_alloc_hint(size_t taille, enum mem_hint hint) {
+    if (hint != MEM_HINT_LONG || get_header()->engine != MEM_ENGINE_LIST)
+        return mem_alloc(taille);
     
-    // Boucle permettant de correctement définir les pointeurs vers les blocs libres précédant et suivant le bloc à libérer.
-    while (after != NULL && after < current) {
-        before = after;
-        after = after->next;
+    STATS_BEGIN();
+    size_t taille_total = get_block_size(taille);
+    struct fb *before = NULL, *current = get_header()->list;
+    struct fb *last = NULL, *last_before = NULL;
+    
+    // On cherche le dernier bloc libre assez grand, et son prédécesseur.
+    while (current != NULL) {
+        STATS_VISIT();
+        if (current->size >= taille_total) {
+            last = current;
+            last_before = before;
+        }
+        before = current;
+        current = fb_next(current);
+    }
+    
+    if (last == NULL) {
+        STATS_END(STATS_ALLOC, taille, stats_strategy());
+        return NULL;
     }
     
+    void *block;
+    
+    /* Si le résidu ne pourrait pas contenir les métadonnées d'un bloc libre, on donne tout le bloc en le retirant de la liste ;
+     * sinon on réduit sa taille, sans toucher au chaînage.
+     */
+    if (last->size - taille_total < sizeof(struct fb)) {
+        if (last_before != NULL)
+            fb_set_next(last_before, fb_next(last));
+        else
+            get_header()->list = fb_next(last);
+        taille_total = last->size;
+        block = last;
+    } else {
+        last->size -= taille_total;
+        block = (void*)last + last->size;
+    }
+    get_header()->compact_resume = NULL;
+    
+    *(block_size_t*)block = taille_total;
+    
+    STATS_END(STATS_ALLOC, taille_total - BLOCK_HEADER, stats_strategy());
+    return block + BLOCK_HEADER;
+}
+
+
+/* Fonction réinsérant dans la liste des blocs libres le bloc occupé current, dont la taille totale (métadonnées comprises) vaut size.
+ * before doit être le bloc libre le plus proche précédant current (NULL s'il n'y en a pas).
+ * On retourne le bloc libre contenant désormais current (before s'ils ont été fusionnés), qui pourra servir de before
+ * pour la libération d'un bloc situé plus loin (voir mem_free_batch()).
+ */
+static struct fb *insert_free_block(struct fb *before, struct fb *current, size_t size) {
+    // Bloc libre le plus proche suivant current.
+    struct fb *after = before != NULL ? fb_next(before) : get_header()->list;
+    
+    get_header()->compact_resume = NULL;
+    
     /* Crée une structure de bloc libre à l'emplacement donné par l'utilisateur, en redéfinissant sa taille
      * en fonction de l'écart de taille entre les métadonnées des blocs libres et celles des blocs occupés.
      */
-    *current = (struct fb) {
-        mem_get_size(mem),
-        after
-    };
+    fb_init(current, size, after);
     
     /* Variables décrivant si les blocs précédant et suivant le bloc actuel sont libres ou pas.
      * Attention : les pointeurs before et after ne correspondent pas forcément à blocs cités ci-dessus,
@@ -270,22 +942,121 @@ void mem_free(void* mem) {
     // Si le bloc se situant juste après le bloc actuel est libre, on le fusionne avec le bloc actuel.
     if (after_is_free == 1) {
         current->size += after->size;
-        current->next = after->next;
+        fb_set_next(current, fb_next(after));
     }
     
     // Si le bloc se situant juste avant le bloc actuel est libre, on le fusionne avec le bloc actuel.
     if (before_is_free == 1) {
         before->size += current->size;
-        before->next = current->next;
+        fb_set_next(before, fb_next(current));
+        return before;
 
     /* Sinon, on doit quand même redéfinir le bloc libre suivant le précédent
      * bloc libre par notre bloc actuel, pour garantir le chaînage des blocs.
      */
     } else if (before != NULL)
-        before->next = current; // Sans cette ligne, before->next pointait sur after.
+        fb_set_next(before, current); // Sans cette ligne, before->next pointait sur after.
 
     else // Cas où il n'existe pas de zone libre avant current
         get_header()->list = current;
+    
+    return current;
+}
+
+
+/* Fonction réinsérant le bloc occupé current (de taille totale size) dans la liste des blocs libres.
+ * Elle est commune à mem_free() et mem_free_sized(), qui ne diffèrent que par la façon d'obtenir size.
+ */
+static void mem_free_block(struct fb *current, size_t size) {
+    struct fb *before = NULL, *after = get_header()->list;
+    
+    // Boucle permettant de correctement définir le bloc libre précédant le bloc à libérer.
+    while (after != NULL && after < current) {
+        STATS_VISIT();
+        before = after;
+        after = fb_next(after);
+    }
+    
+    insert_free_block(before, current, size);
+}
+
+
+/* Fonction permettant de libérer une zone allouée par l'utilisateur.
+ * Le paramètre mem est le pointeur retourné à l'utilisateur lors du mem_alloc().
+ * Ce dernier pointe vers l'adresse correspondant au début de la zone mémoire demandée préalablement par l'utilisateur.
+ */
+void mem_free(void* mem) {
+    STATS_BEGIN();
+
+    if (get_header()->engine == MEM_ENGINE_BUDDY) {
+        size_t k = buddy_block_order(mem);
+        buddy_free(mem, k);
+        STATS_END(STATS_FREE, (size_t) 1 << k, STATS_BUDDY);
+        return;
+    }
+    if (get_header()->engine == MEM_ENGINE_BITMAP) {
+        size_t n = bitmap_block_size(mem);
+        bitmap_free(mem, n);
+        STATS_END(STATS_FREE, n << BITMAP_GRANULE_ORDER, STATS_BITMAP);
+        return;
+    }
+    
+    size_t size = get_block_header(mem - BLOCK_HEADER);
+    mem_free_block((struct fb*)(mem - BLOCK_HEADER), size);
+    STATS_END(STATS_FREE, size - BLOCK_HEADER, stats_strategy());
+}
+
+
+/* Libération avec indication de taille (free_sized() du C23, operator delete(void*, size_t) du C++).
+ * size est la taille demandée lors de l'allocation, ou une taille plus petite demandée depuis à realloc() : celui-ci
+ * garde le bloc quand il suffit, et le C23 permet free_sized(realloc(p, n), n). L'indication ne donne donc pas la taille
+ * du bloc, toujours lue dans ses métadonnées (l'en-tête, que la réinsertion dans la liste des blocs libres réécrit
+ * de toute façon, ou les tables des autres moteurs) ; avec -DDEBUG, on vérifie qu'elle ne dépasse pas la zone.
+ */
+void mem_free_sized(void *mem, size_t size) {
+#ifdef DEBUG
+    assert(size <= mem_get_size(mem));
+#endif
+    (void) size;
+    mem_free(mem);
+}
+
+
+/* Allocation alignée sur alignment octets (puissance de 2) : au delà de ALIGNMENT, on réserve alignment octets de plus,
+ * on aligne le pointeur retourné et on range juste avant lui celui du bloc réellement alloué, pour la libération.
+ */
+size_t mem_aligned_size(size_t taille, size_t alignment) {
+    if (alignment <= ALIGNMENT)
+        return taille;
+    // SIZE_MAX ne peut être servi par aucun moteur.
+    return taille <= SIZE_MAX - alignment ? taille + alignment : SIZE_MAX;
+}
+
+void *mem_align(void *mem, size_t alignment) {
+    if (alignment <= ALIGNMENT || mem == NULL)
+        return mem;
+    
+    // mem est aligné sur ALIGNMENT : il reste au moins ALIGNMENT octets avant res, et au moins taille octets après.
+    void **res = (void**)(((uintptr_t)mem + ALIGNMENT + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    res[-1] = mem;
+    
+    return res;
+}
+
+void *mem_aligned_block(void *ptr, size_t alignment) {
+    return alignment <= ALIGNMENT ? ptr : ((void**)ptr)[-1];
+}
+
+void *mem_alloc_aligned(size_t taille, size_t alignment) {
+    return mem_align(mem_alloc(mem_aligned_size(taille, alignment)), alignment);
+}
+
+void mem_free_aligned(void *mem, size_t alignment) {
+    mem_free(mem_aligned_block(mem, alignment));
+}
+
+void mem_free_aligned_sized(void *mem, size_t size, size_t alignment) {
+    mem_free_sized(mem_aligned_block(mem, alignment), mem_aligned_size(size, alignment));
 }
 
 
@@ -296,10 +1067,11 @@ struct fb* mem_fit_first(struct fb *list, size_t size) {
     struct fb *current = get_header()->list;
     
     while (current != NULL) {
+        STATS_VISIT();
         if (current->size >= size)
             return current;
         
-        current = current->next;
+        current = fb_next(current);
     }
     
     return NULL;
@@ -319,10 +1091,11 @@ struct fb* mem_fit_best(struct fb *list, size_t size) {
 		return NULL;
 	
 	while (current != NULL) {
-		if ((current->size - size >= 0) && (current->size < res->size))
+		STATS_VISIT();
+		if ((current->size >= size) && (current->size < res->size))
 			res = current;
 		
-		current = current->next;
+		current = fb_next(current);
 	}
 	
 	return res;
@@ -337,11 +1110,361 @@ struct fb* mem_fit_worst(struct fb *list, size_t size) {
 		return NULL;
 	
 	while (current != NULL) {
+		STATS_VISIT();
 		if (current->size > res->size)
 			res = current;
 		
-		current = current->next;
+		current = fb_next(current);
 	}
 	
 	return res;
 }
+
+
+/* Allocation groupée : réserve jusqu'à n blocs de taille octets, tous découpés dans un même bloc libre
+ * choisi par la stratégie courante, en une seule recherche et un seul parcours de la liste.
+ * Les pointeurs sont rangés dans out, par adresses croissantes, et on retourne le nombre de blocs effectivement alloués
+ * (qui peut être inférieur à n si le bloc libre trouvé est trop petit : il suffit alors de rappeler la fonction pour le reste).
+ */
+size_t mem_alloc_batch(size_t taille, size_t n, void **out) {
+    size_t taille_total = get_block_size(taille);
+    
+    if (n == 0)
+        return 0;
+    
+    // Les compagnons et les tables de bits n'ont pas de bloc libre à découper : on alloue les blocs un par un.
+    if (get_header()->engine != MEM_ENGINE_LIST) {
+        size_t count = 0;
+        
+        while (count < n && (out[count] = mem_alloc(taille)) != NULL)
+            count++;
+        return count;
+    }
+    
+    struct fb *fb = get_header()->fit(get_header()->list, taille_total);
+    
+    if (fb == NULL)
+        return 0;
+    
+    //On cherche le bloc libre précédent le bloc libre trouvé
+    struct fb *before = NULL, *current = get_header()->list;
+    while (current != fb) {
+        before = current;
+        current = fb_next(current);
+    }
+    
+    // Nombre de blocs que l'on peut découper dans fb, et taille du résidu qui restera libre.
+    size_t count = fb->size / taille_total;
+    if (count > n)
+        count = n;
+    size_t reste = fb->size - count * taille_total, extra = 0;
+    
+    // Le résidu doit pouvoir contenir les métadonnées d'un bloc libre : sinon, il est donné avec le dernier bloc.
+    if (reste < sizeof(struct fb)) {
+        extra = reste;
+        reste = 0;
+    }
+    
+    struct fb *next = fb_next(fb);
+    
+    // On découpe les blocs occupés les uns à la suite des autres.
+    for (size_t i = 0; i < count; i++) {
+        void *block = (void*)fb + i * taille_total;
+        *(block_size_t*)block = taille_total + (i == count - 1 ? extra : 0);
+        out[i] = block + BLOCK_HEADER;
+    }
+    
+    // On remplace fb dans la liste par le résidu (s'il existe) ou par le bloc libre qui le suivait.
+    if (reste != 0) {
+        struct fb *after = (void*)fb + count * taille_total;
+        fb_init(after, reste, next);
+        next = after;
+    }
+    
+    if (before != NULL)
+        fb_set_next(before, next);
+    else
+        get_header()->list = next;
+    get_header()->compact_resume = NULL;
+    
+    return count;
+}
+
+
+/* Fonction triant le tableau de pointeurs ptrs par adresses croissantes (tri de Shell).
+ * On n'utilise pas qsort() car la libc pourrait rappeler malloc() pendant le tri quand on remplace son allocateur.
+ */
+static void sort_pointers(void **ptrs, size_t n) {
+    for (size_t gap = n / 2; gap > 0; gap /= 2) {
+        for (size_t i = gap; i < n; i++) {
+            void *tmp = ptrs[i];
+            size_t j = i;
+            
+            while (j >= gap && ptrs[j - gap] > tmp) {
+                ptrs[j] = ptrs[j - gap];
+                j -= gap;
+            }
+            
+            ptrs[j] = tmp;
+        }
+    }
+}
+
+
+/* Libération groupée des n zones de ptrs (les pointeurs NULL sont ignorés).
+ * Les pointeurs sont triés par adresses croissantes (le tableau est donc réordonné), ce qui permet de tous les
+ * réinsérer et de les fusionner en un seul parcours de la liste des blocs libres au lieu d'un parcours par zone.
+ */
+void mem_free_batch(void **ptrs, size_t n) {
+    struct fb *before = NULL, *after = get_header()->list;
+    
+    if (get_header()->engine != MEM_ENGINE_LIST) {
+        for (size_t i = 0; i < n; i++)
+            if (ptrs[i] != NULL)
+                mem_free(ptrs[i]);
+        return;
+    }
+    
+    sort_pointers(ptrs, n);
+    
+    for (size_t i = 0; i < n; i++) {
+        if (ptrs[i] == NULL)
+            continue;
+        
+        struct fb *current = (struct fb*)(ptrs[i] - BLOCK_HEADER);
+        
+        // On reprend le parcours là où s'est arrêtée la libération précédente.
+        while (after != NULL && after < current) {
+            before = after;
+            after = fb_next(after);
+        }
+        
+        before = insert_free_block(before, current, get_block_header(current));
+        after = fb_next(before);
+    }
+}
+
+
+/* Allocations relogeables
+ * Un bloc alloué par mem_halloc() est un bloc occupé marqué par l'indicateur BLOCK_HANDLE, dont les HANDLE_PREFIX premiers
+ * octets contiennent l'indice de sa poignée dans la table des poignées (elle-même allouée dans la zone). L'utilisateur ne manipule que la poignée et obtient l'adresse
+ * courante des données avec mem_hlock(), ce qui permet à mem_compact() de déplacer les blocs non verrouillés.
+ * Les poignées valent indice + 1 : la poignée 0 signale un échec.
+ */
+
+// Place réservée à l'indice de la poignée, choisie pour que les données de l'utilisateur restent alignées.
+#define HANDLE_PREFIX ALIGNMENT
+
+// Retourne l'indice de poignée inscrit dans le bloc dont l'en-tête est à l'adresse block.
+static inline size_t get_handle_index(void *block) {
+    return *(size_t*)(block + BLOCK_HEADER);
+}
+
+// Retourne l'adresse des données de l'utilisateur pour un bloc de poignée dont l'en-tête est à l'adresse block.
+static inline void *get_handle_data(void *block) {
+    return block + BLOCK_HEADER + HANDLE_PREFIX;
+}
+
+// Retourne l'entrée de la table correspondant à la poignée h, ou NULL si h n'est pas une poignée valide.
+static struct handle *get_handle(mem_handle_t h) {
+    if (h == 0 || h > get_header()->handles_count || get_header()->handles[h - 1].block == NULL)
+        return NULL;
+    
+    return &get_header()->handles[h - 1];
+}
+
+/* Fonction retournant l'indice d'une entrée libre de la table des poignées.
+ * Si la table est pleine, on en alloue une deux fois plus grande dans la zone et on libère l'ancienne.
+ * Retourne handles_count (indice invalide) si la table ne peut pas être agrandie.
+ */
+static size_t get_free_handle() {
+    struct allocator_header *h = get_header();
+    size_t i;
+    
+    for (i = 0; i < h->handles_count; i++)
+        if (h->handles[i].block == NULL)
+            return i;
+    
+    size_t count = h->handles_count == 0 ? 8 : 2 * h->handles_count;
+    struct handle *table = mem_alloc(count * sizeof(struct handle));
+    
+    if (table == NULL)
+        return h->handles_count;
+    
+    if (h->handles != NULL) {
+        memcpy(table, h->handles, h->handles_count * sizeof(struct handle));
+        mem_free(h->handles);
+    }
+    
+    for (i = h->handles_count; i < count; i++)
+        table[i] = (struct handle) { NULL, 0 };
+    
+    i = h->handles_count;
+    h->handles = table;
+    h->handles_count = count;
+    
+    return i;
+}
+
+// Fonction allouant un bloc relogeable de taille octets, retourne sa poignée (0 en cas d'échec).
+mem_handle_t mem_halloc(size_t taille) {
+    // Le préfixe ajouté à la taille ne doit pas la faire déborder.
+    if (taille > SIZE_MAX - HANDLE_PREFIX)
+        return 0;
+
+    size_t i = get_free_handle();
+    
+    if (i == get_header()->handles_count)
+        return 0;
+    
+    void *data = mem_alloc(taille + HANDLE_PREFIX);
+    
+    if (data == NULL)
+        return 0;
+    
+    // On marque le bloc et on y inscrit l'indice de la poignée, pour retrouver la poignée lors d'un déplacement.
+    if (get_header()->engine == MEM_ENGINE_LIST)
+        *(block_size_t*)(data - BLOCK_HEADER) |= BLOCK_HANDLE;
+    *(size_t*)data = i;
+    get_header()->handles[i] = (struct handle) { data - BLOCK_HEADER, 0 };
+    
+    return i + 1;
+}
+
+// Fonction verrouillant le bloc de la poignée h (il ne sera plus déplacé) et retournant l'adresse courante de ses données.
+void *mem_hlock(mem_handle_t h) {
+    struct handle *handle = get_handle(h);
+    
+    if (handle == NULL)
+        return NULL;
+    
+    handle->locks++;
+    return get_handle_data(handle->block);
+}
+
+// Fonction annulant un mem_hlock() : les adresses obtenues auparavant ne doivent plus être utilisées.
+void mem_hunlock(mem_handle_t h) {
+    struct handle *handle = get_handle(h);
+    
+    if (handle != NULL && handle->locks > 0)
+        handle->locks--;
+}
+
+// Fonction libérant le bloc de la poignée h, la poignée pourra être réutilisée par un prochain mem_halloc().
+void mem_hfree(mem_handle_t h) {
+    struct handle *handle = get_handle(h);
+    
+    if (handle == NULL)
+        return;
+    
+    mem_free(handle->block + BLOCK_HEADER);
+    *handle = (struct handle) { NULL, 0 };
+}
+
+/* Fonction indiquant si le bloc occupé dont l'en-tête est à l'adresse block peut être déplacé par mem_compact().
+ * C'est le cas de la table des poignées et des blocs de poignée (indicateur BLOCK_HANDLE) non verrouillés.
+ */
+static int is_movable(void *block) {
+    struct allocator_header *h = get_header();
+    
+    if (h->handles == NULL)
+        return 0;
+    
+    if (block == (void*)h->handles - BLOCK_HEADER)
+        return 1;
+    
+    if ((*(block_size_t*)block & BLOCK_HANDLE) == 0)
+        return 0;
+    
+    size_t i = get_handle_index(block);
+    
+    return i < h->handles_count && h->handles[i].block == block && h->handles[i].locks == 0 ? 1 : 0;
+}
+
+// Nombre de blocs libres passés sans déplacement entre deux lectures de l'horloge par mem_compact()
+#define COMPACT_SKIP_CHECK 64
+
+// Retourne le nombre de microsecondes écoulées depuis start.
+static long elapsed_us(const struct timespec *start) {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000L;
+}
+
+/* Compactage incrémental de la zone.
+ * Chaque bloc déplaçable situé juste après un bloc libre est glissé au début de ce dernier : le bloc libre remonte ainsi
+ * vers la fin de la zone et fusionne avec les blocs libres qu'il rencontre. Les blocs ordinaires et verrouillés restent en place.
+ * On s'arrête dès que budget_us microsecondes se sont écoulées (l'horloge est lue après chaque déplacement et tous les
+ * COMPACT_SKIP_CHECK blocs passés sans déplacement).
+ * Retourne 1 si le budget a été épuisé (il suffit de rappeler la fonction plus tard pour continuer), 0 si le compactage est terminé.
+ * L'appel suivant reprend là où celui-ci s'est arrêté, sauf si la liste des blocs libres a été modifiée entre-temps.
+ * Le système de compagnons n'est pas compacté : un bloc ne peut pas y être déplacé hors de son emplacement de compagnon.
+ * Les zones gérées par tables de bits ne le sont pas non plus : leurs blocs n'ont pas d'en-tête pour repérer les poignées.
+ */
+int mem_compact(long budget_us) {
+    struct timespec start;
+    struct fb *before, *fb;
+    void *end = get_blocks_end();
+    unsigned skipped = 0;
+    
+    if (get_header()->engine != MEM_ENGINE_LIST)
+        return 0;
+    
+    before = get_header()->compact_resume;
+    fb = before != NULL ? fb_next(before) : get_header()->list;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    while (fb != NULL) {
+        // Les blocs libres étant toujours fusionnés, le bloc suivant fb est forcément occupé.
+        void *block = (void*)fb + fb->size;
+        
+        // Une longue suite de blocs non déplaçables doit elle aussi respecter le budget.
+        if (block >= end || !is_movable(block)) {
+            before = fb;
+            fb = fb_next(fb);
+            if (fb != NULL && ++skipped % COMPACT_SKIP_CHECK == 0 && elapsed_us(&start) > budget_us) {
+                get_header()->compact_resume = before;
+                return 1;
+            }
+            continue;
+        }
+        
+        size_t block_size = get_block_header(block), free_size = fb->size;
+        struct fb *next = fb_next(fb);
+        
+        // On déplace le bloc (en-tête compris), puis on met à jour la référence vers ce dernier.
+        memmove(fb, block, block_size);
+        
+        if (block == (void*)get_header()->handles - BLOCK_HEADER)
+            get_header()->handles = (void*)fb + BLOCK_HEADER;
+        else
+            get_header()->handles[get_handle_index(fb)].block = fb;
+        
+        // Le bloc libre se retrouve juste après le bloc déplacé.
+        struct fb *moved = (void*)fb + block_size;
+        fb_init(moved, free_size, next);
+        
+        if (before != NULL)
+            fb_set_next(before, moved);
+        else
+            get_header()->list = moved;
+        
+        // Si le bloc libre rejoint le bloc libre suivant, on les fusionne.
+        if (next != NULL && (void*)next == (void*)moved + moved->size) {
+            moved->size += next->size;
+            fb_set_next(moved, fb_next(next));
+        }
+        
+        fb = moved;
+        
+        if (elapsed_us(&start) > budget_us) {
+            get_header()->compact_resume = before;
+            return 1;
+        }
+    }
+    
+    get_header()->compact_resume = NULL;
+    return 0;
+}
@@ -2,14 +2,70 @@
 #define __MEM_H
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct fb;
 
+/* moteurs de gestion de la zone */
+enum mem_engine {
+    MEM_ENGINE_LIST,   /* liste de blocs libres, stratégie choisie par mem_fit() */
+    MEM_ENGINE_BUDDY,  /* système binaire de compagnons */
+    MEM_ENGINE_BITMAP, /* métadonnées hors des blocs : tables de bits des débuts de blocs et des granules libres */
+};
+
+/* Une zone trop petite pour les métadonnées du moteur et un bloc est refusée : rien n'y est écrit et la zone
+ * utilisée jusque là reste active.
+ * Compagnons : la partie gérée de la zone est découpée en blocs puissances de 2 de tailles décroissantes, qui ne
+ * fusionnent jamais entre eux ; la plus grande allocation possible est donc la plus grande puissance de 2 contenue
+ * dans cette partie. */
+
 /* fonctions principales de l'allocateur */
 void mem_init(void* mem, size_t taille);
+void mem_init_engine(void* mem, size_t taille, enum mem_engine engine);
 void* mem_alloc(size_t size);
 void mem_free(void *ptr);
+void mem_free_sized(void *ptr, size_t size);
 void* mem_realloc(void *old, size_t new_size);
 
+/* plusieurs zones : mem_use() fait opérer les autres fonctions sur la zone mem (déjà initialisée par mem_init()),
+ * sans la réinitialiser, et retourne la zone utilisée jusque là ; mem_current() la retourne sans la changer.
+ * La zone utilisée est propre à chaque thread (mem_init() la choisit pour le thread appelant) : des threads peuvent
+ * opérer en même temps sur des zones différentes, mais pas sur la même sans se synchroniser */
+void* mem_use(void *mem);
+void* mem_current();
+
+/* allocations alignées sur alignment octets (puissance de 2) ; la libération doit donner le même alignement */
+void* mem_alloc_aligned(size_t size, size_t alignment);
+void mem_free_aligned(void *ptr, size_t alignment);
+void mem_free_aligned_sized(void *ptr, size_t size, size_t alignment);
+/* les mêmes en deux temps, pour allouer le bloc autrement (malloc_stub.c) : taille du bloc à réserver (SIZE_MAX si elle
+ * déborde), zone alignée à retourner dans le bloc mem ainsi réservé (NULL si mem l'est), et bloc contenant la zone ptr */
+size_t mem_aligned_size(size_t size, size_t alignment);
+void* mem_align(void *mem, size_t alignment);
+void* mem_aligned_block(void *ptr, size_t alignment);
+
+/* allocation avec indication de durée de vie : les zones de longue durée sont placées à l'autre bout de l'espace libre */
+enum mem_hint {
+    MEM_HINT_NONE,
+    MEM_HINT_SHORT,
+    MEM_HINT_LONG,
+};
+void* mem_alloc_hint(size_t size, enum mem_hint hint);
+
+/* allocations et libérations groupées */
+size_t mem_alloc_batch(size_t size, size_t n, void **out);
+void mem_free_batch(void **ptrs, size_t n);
+
+/* allocations relogeables (par poignées) et compactage de la zone */
+typedef size_t mem_handle_t;
+mem_handle_t mem_halloc(size_t size);
+void *mem_hlock(mem_handle_t h);
+void mem_hunlock(mem_handle_t h);
+void mem_hfree(mem_handle_t h);
+int mem_compact(long budget_us);
+
 /* Itération sur le contenu de l'allocateur */
 /* nécessaire pour le mem_shell */
 void mem_show(void (*print)(void *adr, size_t size, int free));
@@ -18,6 +74,7 @@ void mem_show(void (*print)(void *adr, size_t size, int free));
 /* Si vous avez le temps... */
 typedef struct fb* (mem_fit_function_t)(struct fb*, size_t);
 
+/* taille utilisable de la zone (au moins celle demandée, sans les métadonnées) : realloc() garde la zone si elle suffit */
 size_t mem_get_size(void *zone);
 
 void mem_fit(mem_fit_function_t*);
@@ -25,4 +82,8 @@ mem_fit_function_t mem_fit_first;
 mem_fit_function_t mem_fit_worst;
 mem_fit_function_t mem_fit_best;
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
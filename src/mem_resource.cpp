@@ -0,0 +1,73 @@
+#include "mem_resource.hpp"
+
+#include <new>
+#include <stdexcept>
+
+namespace {
+
+/* Sélectionne une zone pour le thread appelant le temps d'un appel et rétablit la précédente à la sortie.
+ * Le changement ne concerne que ce thread (mem_use()) : les autres, la maintenance de libmalloc.so comprise, continuent
+ * d'opérer sur leur propre zone. Aucune allocation (exception comprise) ne doit être faite sous sa portée.
+ */
+class zone_guard {
+public:
+    explicit zone_guard(void *zone) : previous_(mem_use(zone)) {}
+    ~zone_guard() { mem_use(previous_); }
+
+    zone_guard(const zone_guard &) = delete;
+    zone_guard &operator=(const zone_guard &) = delete;
+
+private:
+    void *previous_;
+};
+
+}
+
+mem_resource::mem_resource(void *zone, std::size_t size, mem_engine engine) : zone_(zone) {
+    bool initialized;
+
+    // mem_init_engine() ne sélectionne la zone que si elle l'accepte.
+    {
+        zone_guard guard(nullptr);
+
+        mem_init_engine(zone, size, engine);
+        initialized = mem_current() == zone;
+    }
+    if (!initialized)
+        throw std::invalid_argument("mem_resource : zone refusee par mem_init_engine()");
+}
+
+void mem_resource::fit(mem_fit_function_t *f) {
+    zone_guard guard(zone_);
+
+    mem_fit(f);
+}
+
+void mem_resource::show(void (*print)(void *adr, std::size_t size, int free)) const {
+    zone_guard guard(zone_);
+
+    mem_show(print);
+}
+
+void *mem_resource::do_allocate(std::size_t bytes, std::size_t alignment) {
+    void *p;
+
+    {
+        zone_guard guard(zone_);
+
+        p = mem_alloc_aligned(bytes, alignment);
+    }
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void mem_resource::do_deallocate(void *p, std::size_t bytes, std::size_t alignment) {
+    zone_guard guard(zone_);
+
+    mem_free_aligned_sized(p, bytes, alignment);
+}
+
+bool mem_resource::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
@@ -0,0 +1,42 @@
+#ifndef __MEM_RESOURCE_HPP__
+#define __MEM_RESOURCE_HPP__
+#include "mem.h"
+
+#include <cstddef>
+#include <memory_resource>
+
+/* Ressource mémoire std::pmr sur une zone gérée par mem.c
+ *
+ * La zone [zone, zone + size[ est initialisée à la construction avec le moteur demandé (std::invalid_argument si
+ * mem_init_engine() la refuse : trop petite, ou taille non multiple de 8) ; les conteneurs std::pmr
+ * construits sur la ressource y placent alors toutes leurs allocations, par exemple :
+ *     mem_resource heap(buffer, sizeof(buffer));
+ *     std::pmr::vector<int> v(&heap);
+ * Plusieurs ressources peuvent coexister (entre elles et avec la zone de libmalloc.so) : chaque appel sélectionne sa
+ * zone pour le thread appelant par mem_use() puis rétablit la précédente. Des threads peuvent donc utiliser en même
+ * temps des ressources différentes ; comme std::pmr::unsynchronized_pool_resource, une même ressource n'est pas
+ * protégée contre les appels concurrents.
+ * Les libérations utilisent la taille et l'alignement fournis par l'appelant (mem_free_aligned_sized()).
+ */
+class mem_resource : public std::pmr::memory_resource {
+public:
+    mem_resource(void *zone, std::size_t size, mem_engine engine = MEM_ENGINE_LIST);
+
+    mem_resource(const mem_resource &) = delete;
+    mem_resource &operator=(const mem_resource &) = delete;
+
+    // Choix de la stratégie de la liste de blocs libres (voir mem_fit())
+    void fit(mem_fit_function_t *f);
+
+    // Parcours des blocs de la zone (voir mem_show())
+    void show(void (*print)(void *adr, std::size_t size, int free)) const;
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+    void *zone_;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "malloc_stub.h"
+
+#include <cstddef>
+#include <new>
+
+/* Remplacement des opérateurs new et delete globaux (libmallocxx.so)
+ *
+ * Ils passent par malloc_site() et free_site() de malloc_stub.c, c'est-à-dire par les mêmes chemins que malloc() et
+ * free() : verrou du tas si la maintenance est active, journal (LIBMALLOC_LOG) et apprentissage des durées de vie
+ * (hint:learn), avec pour site l'adresse de retour de l'opérateur. La zone est celle de libmalloc.so (LIBMALLOC_CONF).
+ * La taille donnée aux libérations (C++14) n'est que journalisée : le bloc libéré est celui décrit par ses métadonnées.
+ */
+
+namespace {
+
+// Allocation conforme à la norme : en cas d'échec, on appelle le new_handler installé, ou on lève std::bad_alloc.
+void *allocate(std::size_t size, std::size_t alignment, void *site) {
+    void *p;
+
+    while ((p = malloc_site(size, alignment, site)) == nullptr) {
+        std::new_handler handler = std::get_new_handler();
+
+        if (handler == nullptr)
+            throw std::bad_alloc();
+        handler();
+    }
+    return p;
+}
+
+void *allocate_nothrow(std::size_t size, std::size_t alignment, void *site) noexcept {
+    try {
+        return allocate(size, alignment, site);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+/* Les variantes sans alignement doivent aligner comme le compilateur le suppose (16 octets sur x86-64) : c'est déjà
+ * l'alignement des blocs de l'allocateur, malloc_site() ne réserve donc rien de plus pour elles.
+ */
+constexpr std::size_t new_alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+}
+
+void *operator new(std::size_t size) {
+    return allocate(size, new_alignment, __builtin_return_address(0));
+}
+
+void *operator new[](std::size_t size) {
+    return allocate(size, new_alignment, __builtin_return_address(0));
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate_nothrow(size, new_alignment, __builtin_return_address(0));
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate_nothrow(size, new_alignment, __builtin_return_address(0));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return allocate_nothrow(size, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return allocate_nothrow(size, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void operator delete(void *p) noexcept {
+    free_site(p, 0, new_alignment, __builtin_return_address(0));
+}
+
+void operator delete[](void *p) noexcept {
+    free_site(p, 0, new_alignment, __builtin_return_address(0));
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    free_site(p, 0, new_alignment, __builtin_return_address(0));
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    free_site(p, 0, new_alignment, __builtin_return_address(0));
+}
+
+void operator delete(void *p, std::size_t size) noexcept {
+    free_site(p, size, new_alignment, __builtin_return_address(0));
+}
+
+void operator delete[](void *p, std::size_t size) noexcept {
+    free_site(p, size, new_alignment, __builtin_return_address(0));
+}
+
+void operator delete(void *p, std::align_val_t alignment) noexcept {
+    free_site(p, 0, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void operator delete[](void *p, std::align_val_t alignment) noexcept {
+    free_site(p, 0, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void operator delete(void *p, std::size_t size, std::align_val_t alignment) noexcept {
+    free_site(p, size, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void operator delete[](void *p, std::size_t size, std::align_val_t alignment) noexcept {
+    free_site(p, size, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void operator delete(void *p, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    free_site(p, 0, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
+
+void operator delete[](void *p, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    free_site(p, 0, static_cast<std::size_t>(alignment), __builtin_return_address(0));
+}
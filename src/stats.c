@@ -0,0 +1,222 @@
+#include "stats.h"
+
+#ifdef MEM_STATS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+__thread uint64_t stats_nodes;
+
+/* Mesures de chaque thread : seul le thread propriétaire écrit dans les siennes, sans verrou. */
+static struct stats threads[STATS_MAX_THREADS];
+static unsigned int threads_count = 0;
+
+static __thread struct stats *thread_stats;
+static __thread int thread_registered = 0;
+
+static const char *op_names[] = {
+    [STATS_ALLOC] = "mem_alloc",
+    [STATS_FREE] = "mem_free",
+    [STATS_REALLOC] = "realloc",
+    [STATS_CALLOC] = "calloc",
+};
+
+static const char *strategy_names[] = {
+    [STATS_FIRST] = "first",
+    [STATS_BEST] = "best",
+    [STATS_WORST] = "worst",
+    [STATS_BUDDY] = "buddy",
+    [STATS_BITMAP] = "bitmap",
+    [STATS_OTHER] = "autre",
+};
+
+// Retourne les mesures du thread appelant, en lui en attribuant lors de son premier appel (NULL s'il n'en reste plus).
+static struct stats *get_stats() {
+    if (!thread_registered) {
+        unsigned int i = __atomic_fetch_add(&threads_count, 1, __ATOMIC_RELAXED);
+
+        thread_stats = i < STATS_MAX_THREADS ? &threads[i] : NULL;
+        thread_registered = 1;
+    }
+    return thread_stats;
+}
+
+static unsigned int registered_threads() {
+    unsigned int n = __atomic_load_n(&threads_count, __ATOMIC_RELAXED);
+
+    return n < STATS_MAX_THREADS ? n : STATS_MAX_THREADS;
+}
+
+/* Intervalle de l'histogramme contenant value : les valeurs inférieures à 2^STATS_SUB_BITS ont chacune le leur,
+ * au delà, l'exposant de value choisit la puissance de 2 et ses STATS_SUB_BITS bits suivants l'intervalle dans celle-ci.
+ */
+static size_t bucket(uint64_t value) {
+    if (value < (1 << STATS_SUB_BITS))
+        return value;
+
+    size_t exponent = 63 - __builtin_clzll(value);
+
+    if (exponent >= STATS_MAX_BITS)
+        return STATS_BUCKETS - 1;
+    return ((exponent - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+           + ((value >> (exponent - STATS_SUB_BITS)) & ((1 << STATS_SUB_BITS) - 1));
+}
+
+// Plus grande valeur comptée dans l'intervalle b.
+static uint64_t bucket_limit(size_t b) {
+    if (b < (1 << STATS_SUB_BITS))
+        return b;
+
+    size_t exponent = (b >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+    uint64_t sub = b & ((1 << STATS_SUB_BITS) - 1);
+
+    return (((1 << STATS_SUB_BITS) + sub + 1) << (exponent - STATS_SUB_BITS)) - 1;
+}
+
+static size_t size_class(size_t size) {
+    size_t c = 0;
+
+    while (c < STATS_SIZE_CLASSES - 1 && size > (size_t) 16 << c)
+        c++;
+    return c;
+}
+
+static void histogram_add(struct stats_histogram *h, uint64_t value) {
+    h->count++;
+    h->sum += value;
+    if (value > h->max)
+        h->max = value;
+    h->buckets[bucket(value)]++;
+}
+
+static void histogram_merge(struct stats_histogram *to, const struct stats_histogram *from) {
+    to->count += from->count;
+    to->sum += from->sum;
+    if (from->max > to->max)
+        to->max = from->max;
+    for (size_t b = 0; b < STATS_BUCKETS; b++)
+        to->buckets[b] += from->buckets[b];
+}
+
+void stats_record(enum stats_op op, size_t size, enum stats_strategy strategy, uint64_t cycles, uint64_t nodes) {
+    struct stats *s = get_stats();
+
+    if (s == NULL)
+        return;
+
+    struct stats_op_stats *o = &s->ops[op];
+
+    histogram_add(&o->by_size[size_class(size)], cycles);
+    histogram_add(&o->by_strategy[strategy], cycles);
+    o->nodes += nodes;
+    if (nodes > o->nodes_max)
+        o->nodes_max = nodes;
+}
+
+void stats_query(struct stats *out) {
+    unsigned int n = registered_threads();
+
+    memset(out, 0, sizeof(*out));
+    for (unsigned int i = 0; i < n; i++)
+        for (int op = 0; op < STATS_OPS; op++) {
+            struct stats_op_stats *to = &out->ops[op], *from = &threads[i].ops[op];
+
+            for (int c = 0; c < STATS_SIZE_CLASSES; c++)
+                histogram_merge(&to->by_size[c], &from->by_size[c]);
+            for (int st = 0; st < STATS_STRATEGIES; st++)
+                histogram_merge(&to->by_strategy[st], &from->by_strategy[st]);
+            to->nodes += from->nodes;
+            if (from->nodes_max > to->nodes_max)
+                to->nodes_max = from->nodes_max;
+        }
+}
+
+void stats_reset() {
+    unsigned int n = registered_threads();
+
+    for (unsigned int i = 0; i < n; i++)
+        memset(&threads[i], 0, sizeof(threads[i]));
+}
+
+uint64_t stats_percentile(const struct stats_histogram *h, double p) {
+    uint64_t rank = (uint64_t) (h->count * p / 100), seen = 0;
+
+    for (size_t b = 0; b < STATS_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen > rank)
+            return bucket_limit(b) < h->max ? bucket_limit(b) : h->max;
+    }
+    return h->max;
+}
+
+// Écrit une ligne résumant l'histogramme h, s'il n'est pas vide.
+static void dump_histogram(int fd, const char *label, const struct stats_histogram *h) {
+    char line[256];
+    int n;
+
+    if (h->count == 0)
+        return;
+
+    n = snprintf(line, sizeof(line),
+                 "  %-10s %10llu appels, moyenne %8.1f, p50 %8llu, p99 %8llu, p99.9 %8llu, max %10llu\n",
+                 label, (unsigned long long) h->count, (double) h->sum / h->count,
+                 (unsigned long long) stats_percentile(h, 50), (unsigned long long) stats_percentile(h, 99),
+                 (unsigned long long) stats_percentile(h, 99.9), (unsigned long long) h->max);
+    if (n > 0 && write(fd, line, n < (int) sizeof(line) ? n : (int) sizeof(line) - 1) < 0)
+        return;
+}
+
+/* La structure cumulée est trop grosse pour la pile d'un thread quelconque : stats_dump() n'est donc pas réentrante. */
+void stats_dump(int fd) {
+    static struct stats total;
+    char line[256], label[16];
+    int n;
+
+    stats_query(&total);
+    for (int op = 0; op < STATS_OPS; op++) {
+        struct stats_op_stats *o = &total.ops[op];
+        struct stats_histogram all = { 0 };
+
+        for (int st = 0; st < STATS_STRATEGIES; st++)
+            histogram_merge(&all, &o->by_strategy[st]);
+        if (all.count == 0)
+            continue;
+
+        n = snprintf(line, sizeof(line), "%s (cycles) : %.1f blocs libres parcourus en moyenne, %llu au plus\n",
+                     op_names[op], (double) o->nodes / all.count, (unsigned long long) o->nodes_max);
+        if (write(fd, line, n < (int) sizeof(line) ? n : (int) sizeof(line) - 1) < 0)
+            return;
+
+        dump_histogram(fd, "total", &all);
+        for (int c = 0; c < STATS_SIZE_CLASSES; c++) {
+            if (c < STATS_SIZE_CLASSES - 1)
+                snprintf(label, sizeof(label), "<= %d", 16 << c);
+            else
+                snprintf(label, sizeof(label), "> %d", 16 << (c - 1));
+            dump_histogram(fd, label, &o->by_size[c]);
+        }
+        for (int st = 0; st < STATS_STRATEGIES; st++)
+            dump_histogram(fd, strategy_names[st], &o->by_strategy[st]);
+    }
+}
+
+// Écriture des mesures à la fin du programme.
+__attribute__((destructor))
+static void stats_fini() {
+    char *path = getenv(STATS_ENV);
+    int fd = STDERR_FILENO;
+
+    if (path != NULL && *path != '\0')
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return;
+
+    stats_dump(fd);
+    if (fd != STDERR_FILENO)
+        close(fd);
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Histogrammes de latence des opérations de l'allocateur
+ *
+ * En compilant avec -DMEM_STATS, mem_alloc(), mem_free() (et mem_free_sized()) dans mem.c, ainsi que realloc() et
+ * calloc() dans malloc_stub.c, mesurent leur durée en cycles et le nombre de blocs de la liste libre parcourus.
+ * Chaque thread range ses mesures dans ses propres histogrammes log-linéaires (chaque puissance de 2 est découpée en
+ * 2^STATS_SUB_BITS intervalles égaux, soit une précision relative de 12,5 %), par taille et par stratégie.
+ * Pour mem_alloc() et mem_free(), la taille est celle du bloc donné ou rendu telle que la retourne mem_get_size() :
+ * un bloc est ainsi compté dans la même classe à l'allocation et à la libération (taille demandée si l'allocation échoue).
+ * Pour realloc() et calloc(), c'est la taille demandée.
+ * Les histogrammes sont écrits à la fin du programme dans le fichier désigné par STATS_ENV (sur la sortie d'erreur sinon).
+ * Sans -DMEM_STATS, les macros ci-dessous ne produisent aucun code et stats.c est vide.
+ */
+
+#define STATS_ENV "MEM_STATS_FILE"
+
+#define STATS_MAX_THREADS 64
+#define STATS_SUB_BITS 3
+#define STATS_MAX_BITS 40 /* les durées de 2^40 cycles et plus sont comptées dans le dernier intervalle */
+#define STATS_BUCKETS ((STATS_MAX_BITS - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+
+/* classes de tailles : jusqu'à 16 octets, 32, 64, ..., 1024, puis au delà */
+#define STATS_SIZE_CLASSES 8
+
+enum stats_op {
+    STATS_ALLOC,
+    STATS_FREE,
+    STATS_REALLOC, /* comprend le mem_alloc() et le mem_free() éventuels, aussi comptés de leur côté */
+    STATS_CALLOC,  /* idem pour le mem_alloc() */
+    STATS_OPS,
+};
+
+enum stats_strategy {
+    STATS_FIRST,
+    STATS_BEST,
+    STATS_WORST,
+    STATS_BUDDY,
+    STATS_BITMAP,
+    STATS_OTHER, /* stratégie donnée à mem_fit() par l'utilisateur */
+    STATS_STRATEGIES,
+};
+
+struct stats_histogram {
+    uint64_t count;
+    uint64_t sum; /* somme des durées, en cycles */
+    uint64_t max;
+    uint32_t buckets[STATS_BUCKETS];
+};
+
+struct stats_op_stats {
+    struct stats_histogram by_size[STATS_SIZE_CLASSES];
+    struct stats_histogram by_strategy[STATS_STRATEGIES];
+    uint64_t nodes;     /* nombre total de blocs libres (mots des tables de bits pour MEM_ENGINE_BITMAP) parcourus */
+    uint64_t nodes_max; /* nombre maximal de blocs libres parcourus par une opération */
+};
+
+struct stats {
+    struct stats_op_stats ops[STATS_OPS];
+};
+
+#ifdef MEM_STATS
+
+/* nombre de blocs libres parcourus par le thread : STATS_END() en retranche la valeur relevée par STATS_BEGIN(),
+ * les opérations imbriquées (le mem_alloc() d'un realloc()) sont ainsi comptées dans l'opération englobante. */
+extern __thread uint64_t stats_nodes;
+
+// Compteur de cycles du processeur (horloge monotone, en nanosecondes, hors x86).
+static inline uint64_t stats_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+/* Stratégie de la zone gérée par mem.c */
+enum stats_strategy stats_strategy();
+
+void stats_record(enum stats_op op, size_t size, enum stats_strategy strategy, uint64_t cycles, uint64_t nodes);
+
+/* Cumule dans out les mesures de tous les threads (out est remis à zéro auparavant).
+ * Les mesures des autres threads sont lues sans les arrêter : celles en cours d'écriture peuvent manquer.
+ */
+void stats_query(struct stats *out);
+
+/* Remet à zéro les mesures de tous les threads, avec la même réserve que pour stats_query() */
+void stats_reset();
+
+/* Durée (borne supérieure de l'intervalle, en cycles) en deçà de laquelle se trouvent p % des mesures de h */
+uint64_t stats_percentile(const struct stats_histogram *h, double p);
+
+/* Écrit un résumé des mesures de tous les threads sur le descripteur fd, avec write() uniquement */
+void stats_dump(int fd);
+
+/* Instrumentation d'une opération : STATS_BEGIN() au début, STATS_END() à la fin, STATS_VISIT() pour chaque bloc parcouru */
+#define STATS_BEGIN()                                                           \
+    uint64_t stats_start = stats_cycles(), stats_first_node = stats_nodes
+#define STATS_VISIT() (stats_nodes++)
+#define STATS_END(op, size, strategy)                                           \
+    stats_record(op, size, strategy, stats_cycles() - stats_start, stats_nodes - stats_first_node)
+
+#else
+
+#define STATS_BEGIN()
+#define STATS_VISIT() ((void) 0)
+#define STATS_END(op, size, strategy)
+
+#endif
+
+#endif
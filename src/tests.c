@@ -1,14 +1,18 @@
 #include "mem.h"
+#include "stats.h"
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 
 #define MEMORY_SIZE 2048L
 
 // Constantes utilisées à des fins d'affichage (car on n'a pas accès aux structures de mem.c)
-#define SIZE_OF_STRUCT_ALLOCATOR_HEADER 24L
+#define SIZE_OF_STRUCT_ALLOCATOR_HEADER 56L
 #define SIZE_OF_STRUCT_FB 16L
 
 
@@ -249,6 +253,397 @@ void test_09() {
 }
 
 
+// Allocation de quatre zones et libération de deux d'entre elles avec indication de taille (mem_free_sized) afin qu'elles se ré-assemblent
+void test_10() {
+	printf("\nTest 10 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE);
+    mem_init(mem, MEMORY_SIZE);
+    printf("Mémoire initialisée : taille %ld\n", (size_t) MEMORY_SIZE);
+
+    mem_alloc(256);
+    void *ptr1 = mem_alloc(500);
+    void *ptr2 = mem_alloc(3);
+    mem_alloc(1024);
+
+    mem_free_sized(ptr2, 3);
+    mem_free_sized(ptr1, 500);
+
+    mem_show(&print);
+
+    free(mem);
+    printf("\nMémoire libérée. Test 10 terminé.\n\n");
+}
+
+
+// Allocation groupée de six zones de même taille, puis libération groupée de quatre d'entre elles dans le désordre
+void test_11() {
+	printf("\nTest 11 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE);
+    mem_init(mem, MEMORY_SIZE);
+    printf("Mémoire initialisée : taille %ld\n", (size_t) MEMORY_SIZE);
+
+    void *ptrs[6];
+    size_t count = mem_alloc_batch(128, 6, ptrs);
+    printf("%zu zones allouées\n", count);
+
+    void *to_free[4] = { ptrs[4], ptrs[1], ptrs[2], ptrs[5] };
+    mem_free_batch(to_free, 4);
+
+    mem_show(&print);
+
+    free(mem);
+    printf("\nMémoire libérée. Test 11 terminé.\n\n");
+}
+
+
+// Allocation de blocs relogeables entrecoupés d'un bloc ordinaire, libération de certains d'entre eux puis compactage de la zone
+void test_12() {
+	printf("\nTest 12 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE);
+    mem_init(mem, MEMORY_SIZE);
+    printf("Mémoire initialisée : taille %ld\n", (size_t) MEMORY_SIZE);
+
+    mem_handle_t h1 = mem_halloc(256);
+    mem_handle_t h2 = mem_halloc(128);
+    mem_handle_t h3 = mem_halloc(64);
+    mem_alloc(512);
+    mem_handle_t h4 = mem_halloc(64);
+    printf("Poignée demandée pour SIZE_MAX octets : %zu (refusée)\n", mem_halloc(SIZE_MAX));
+
+    // On écrit dans h3 pour vérifier que ses données suivent le bloc lors du déplacement
+    char *data = mem_hlock(h3);
+    for (int i = 0; i < 64; i++)
+        data[i] = i;
+    mem_hunlock(h3);
+
+    mem_hfree(h1);
+    mem_hfree(h2);
+
+    printf("Avant compactage :\n");
+    mem_show(&print);
+
+    // Compactage complet, avec h4 verrouillé : seul h3 peut être glissé (le bloc ordinaire ne bouge pas)
+    mem_hlock(h4);
+    while (mem_compact(0));
+    mem_hunlock(h4);
+
+    printf("Après compactage :\n");
+    mem_show(&print);
+
+    data = mem_hlock(h3);
+    int ok = 1;
+    for (int i = 0; i < 64; i++)
+        ok = ok && data[i] == i;
+    printf("Données de la poignée %zu %s\n", h3, ok ? "conservées" : "CORROMPUES");
+    mem_hunlock(h3);
+
+    free(mem);
+    printf("\nMémoire libérée. Test 12 terminé.\n\n");
+}
+
+
+// Système de compagnons : allocation de trois zones, puis libération de deux compagnons qui doivent fusionner
+void test_13() {
+	printf("\nTest 13 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE);
+    mem_init_engine(mem, MEMORY_SIZE, MEM_ENGINE_BUDDY);
+    printf("Mémoire initialisée (compagnons) : taille %ld\n", (size_t) MEMORY_SIZE);
+
+    void *ptr1 = mem_alloc(100);
+    void *ptr2 = mem_alloc(100);
+    mem_alloc(20);
+
+    printf("Avant libération :\n");
+    mem_show(&print);
+
+    mem_free(ptr1);
+    mem_free_sized(ptr2, 100);
+
+    printf("Après libération :\n");
+    mem_show(&print);
+
+    free(mem);
+    printf("\nMémoire libérée. Test 13 terminé.\n\n");
+}
+
+
+// Allocations avec indication de durée de vie : les zones de longue durée doivent se trouver en fin de zone
+void test_14() {
+	printf("\nTest 14 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE);
+    mem_init(mem, MEMORY_SIZE);
+    printf("Mémoire initialisée : taille %ld\n", (size_t) MEMORY_SIZE);
+
+    void *ptr1 = mem_alloc_hint(256, MEM_HINT_SHORT);
+    mem_alloc_hint(128, MEM_HINT_LONG);
+    void *ptr2 = mem_alloc_hint(512, MEM_HINT_SHORT);
+    mem_alloc_hint(64, MEM_HINT_LONG);
+
+    // Les zones de courte durée libérées fusionnent en un seul bloc libre
+    mem_free(ptr1);
+    mem_free(ptr2);
+
+    mem_show(&print);
+
+    free(mem);
+    printf("\nMémoire libérée. Test 14 terminé.\n\n");
+}
+
+
+
+#ifdef MEM_STATS
+// Nombre total d'opérations op mesurées (toutes stratégies confondues)
+static uint64_t stats_count(struct stats *s, enum stats_op op) {
+    uint64_t count = 0;
+
+    for (int st = 0; st < STATS_STRATEGIES; st++)
+        count += s->ops[op].by_strategy[st].count;
+    return count;
+}
+
+// Mesure de la latence (compilé avec -DMEM_STATS) : chaque allocation et libération est comptée une fois
+void test_15() {
+	static struct stats s;
+
+	printf("\nTest 15 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE);
+    mem_init(mem, MEMORY_SIZE);
+    stats_reset();
+
+    void *ptr1 = mem_alloc(10);
+    void *ptr2 = mem_alloc(100);
+    mem_alloc(1000);
+    mem_free(ptr1);
+    mem_free_sized(ptr2, 100);
+
+    stats_query(&s);
+    printf("Allocations mesurées : %llu, libérations mesurées : %llu, blocs libres parcourus : %llu\n",
+           (unsigned long long) stats_count(&s, STATS_ALLOC), (unsigned long long) stats_count(&s, STATS_FREE),
+           (unsigned long long) (s.ops[STATS_ALLOC].nodes + s.ops[STATS_FREE].nodes));
+    // Les tailles comptées sont celles des blocs : le bloc de 10 octets est dans la même classe des deux côtés
+    printf("Allocations de 16 octets au plus : %llu, libérations : %llu\n",
+           (unsigned long long) s.ops[STATS_ALLOC].by_size[0].count,
+           (unsigned long long) s.ops[STATS_FREE].by_size[0].count);
+
+    stats_reset();
+    stats_query(&s);
+    printf("Après remise à zéro : %llu allocations mesurées\n", (unsigned long long) stats_count(&s, STATS_ALLOC));
+
+    free(mem);
+    printf("\nMémoire libérée. Test 15 terminé.\n\n");
+}
+#endif
+
+// Deux zones utilisées tour à tour, et allocation alignée sur 64 octets dans la seconde
+void test_16() {
+	printf("\nTest 16 :\n\n");
+
+	void *mem1 = malloc(MEMORY_SIZE);
+	void *mem2 = malloc(MEMORY_SIZE);
+    mem_init(mem1, MEMORY_SIZE);
+    void *ptr1 = mem_alloc(100);
+    mem_init(mem2, MEMORY_SIZE);
+    void *ptr2 = mem_alloc_aligned(100, 64);
+    printf("Zone alignée sur 64 octets : %s\n", (size_t) ptr2 % 64 == 0 ? "oui" : "non");
+
+    printf("Première zone :\n");
+    mem_use(mem1);
+    mem_show(&print);
+    mem_free(ptr1);
+
+    printf("Seconde zone :\n");
+    mem_use(mem2);
+    mem_show(&print);
+    mem_free_aligned_sized(ptr2, 100, 64);
+    printf("Seconde zone après libération :\n");
+    mem_show(&print);
+
+    free(mem1);
+    free(mem2);
+    printf("\nMémoire libérée. Test 16 terminé.\n\n");
+}
+
+// Métadonnées hors des blocs : les zones libérées voisines forment un seul bloc libre, sans fusion explicite
+void test_17() {
+	printf("\nTest 17 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE);
+    mem_init_engine(mem, MEMORY_SIZE, MEM_ENGINE_BITMAP);
+    printf("Mémoire initialisée (tables de bits) : taille %ld\n", (size_t) MEMORY_SIZE);
+
+    void *ptr1 = mem_alloc(100);
+    void *ptr2 = mem_alloc(20);
+    mem_alloc(200);
+    printf("Taille utilisable de la première zone : %ld\n", mem_get_size(ptr1));
+
+    printf("Avant libération :\n");
+    mem_show(&print);
+
+    mem_free(ptr1);
+    mem_free_sized(ptr2, 20);
+
+    printf("Après libération :\n");
+    mem_show(&print);
+
+    free(mem);
+    printf("\nMémoire libérée. Test 17 terminé.\n\n");
+}
+
+// Taille utilisable : comme le fait realloc(), on remplit toute la zone donnée par mem_get_size(), sans toucher à la suivante
+void test_18() {
+	printf("\nTest 18 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE);
+    mem_init(mem, MEMORY_SIZE);
+    printf("Mémoire initialisée : taille %ld\n", (size_t) MEMORY_SIZE);
+
+    char *ptr1 = mem_alloc(12);
+    char *ptr2 = mem_alloc(12);
+    for (int i = 0; i < 12; i++)
+        ptr2[i] = i;
+    size_t size2 = mem_get_size(ptr2);
+
+    size_t size = mem_get_size(ptr1);
+    printf("Taille utilisable d'une zone de 12 octets : %ld\n", size);
+    for (size_t i = 0; i < size; i++)
+        ptr1[i] = -1;
+
+    // L'en-tête de la zone suivante (sa taille) doit lui aussi être intact.
+    int ok = mem_get_size(ptr2) == size2;
+    for (int i = 0; i < 12; i++)
+        ok = ok && ptr2[i] == i;
+    printf("Zone suivante %s\n", ok ? "intacte" : "ECRASEE");
+    mem_show(&print);
+
+    free(mem);
+    printf("\nMémoire libérée. Test 18 terminé.\n\n");
+}
+
+// Libération avec une taille plus petite que celle de l'allocation, comme après un realloc() qui a gardé le bloc
+void test_19() {
+	printf("\nTest 19 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE);
+    mem_init(mem, MEMORY_SIZE);
+    printf("Mémoire initialisée : taille %ld\n", (size_t) MEMORY_SIZE);
+
+    void *ptr1 = mem_alloc(200);
+    mem_alloc(20);
+    mem_free_sized(ptr1, 40);
+
+    // Le bloc libéré a toute sa taille d'origine
+    mem_show(&print);
+
+    free(mem);
+    printf("\nMémoire libérée. Test 19 terminé.\n\n");
+}
+
+// Blocs de la liste alignés sur 16 octets : toutes les zones le sont, et un bloc libéré est réutilisé entier
+void test_20() {
+	printf("\nTest 20 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE);
+    mem_init(mem, MEMORY_SIZE);
+    printf("Mémoire initialisée : taille %ld\n", (size_t) MEMORY_SIZE);
+
+    // Un bloc de 112 octets, puis on remplit tout le reste de la zone
+    void *ptr1 = mem_alloc(100), *ptr;
+    int aligned = (size_t) ptr1 % 16 == 0;
+    while ((ptr = mem_alloc(8)) != NULL)
+        aligned = aligned && (size_t) ptr % 16 == 0;
+    printf("Zones alignées sur 16 octets : %s\n", aligned ? "oui" : "NON");
+    mem_free(ptr1);
+
+    // 96 octets demandent aussi un bloc de 112 octets (les tailles de blocs sont des multiples de 16)
+    void *ptr2 = mem_alloc(96);
+    printf("Allocation de 96 octets %s, taille utilisable %ld\n", ptr2 == ptr1 ? "dans le bloc libéré" : "ECHOUEE",
+           ptr2 != NULL ? mem_get_size(ptr2) : 0);
+
+    if (ptr2 != NULL) {
+        mem_free_sized(ptr2, 96);
+        printf("Bloc libéré de nouveau : %s\n", mem_alloc(100) == ptr1 ? "oui" : "non");
+    }
+
+    free(mem);
+    printf("\nMémoire libérée. Test 20 terminé.\n\n");
+}
+
+// Zones trop petites pour les métadonnées d'un moteur : refusées sans rien écrire, la zone précédente reste utilisée
+void test_21() {
+	printf("\nTest 21 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE);
+    mem_init(mem, MEMORY_SIZE);
+    printf("Mémoire initialisée : taille %ld\n", (size_t) MEMORY_SIZE);
+
+    const char *names[] = { "liste", "compagnons", "tables de bits" };
+    char small[128];
+    for (int engine = MEM_ENGINE_LIST; engine <= MEM_ENGINE_BITMAP; engine++) {
+        memset(small, 0x5a, sizeof(small));
+        mem_init_engine(small, 32, engine);
+        int untouched = 1;
+        for (size_t i = 0; i < sizeof(small); i++)
+            untouched &= small[i] == 0x5a;
+        printf("Zone de 32 octets, moteur %s : %s, zone courante %s\n", names[engine],
+               untouched ? "refusée" : "ECRITE", mem_current() == mem ? "inchangée" : "REMPLACEE");
+    }
+
+    free(mem);
+    printf("\nMémoire libérée. Test 21 terminé.\n\n");
+}
+
+// Chaque thread opère sur sa propre zone
+static void *zone_worker(void *arg) {
+    void *mem = arg, *ptrs[64] = { NULL };
+    int ok = 1;
+
+    mem_init(mem, MEMORY_SIZE);
+    for (int i = 0; i < 20000; i++) {
+        int slot = (i * 7) % 64;
+
+        if (ptrs[slot] != NULL) {
+            ok = ok && *(int*)ptrs[slot] == slot;
+            mem_free(ptrs[slot]);
+        }
+        ptrs[slot] = mem_alloc(8 + slot % 24);
+        if (ptrs[slot] != NULL)
+            *(int*)ptrs[slot] = slot;
+        ok = ok && mem_current() == mem;
+    }
+    return ok ? mem : NULL;
+}
+
+// Deux threads allouent en même temps dans deux zones différentes, pendant que la zone du thread principal reste choisie
+void test_22() {
+	printf("\nTest 22 :\n\n");
+
+	void *mem = malloc(MEMORY_SIZE), *mem1 = malloc(MEMORY_SIZE), *mem2 = malloc(MEMORY_SIZE);
+    mem_init(mem, MEMORY_SIZE);
+    void *ptr = mem_alloc(100);
+
+    pthread_t t1, t2;
+    void *r1, *r2;
+    pthread_create(&t1, NULL, zone_worker, mem1);
+    pthread_create(&t2, NULL, zone_worker, mem2);
+    pthread_join(t1, &r1);
+    pthread_join(t2, &r2);
+
+    printf("Zones des deux threads : %s, %s\n", r1 == mem1 ? "intacte" : "CORROMPUE", r2 == mem2 ? "intacte" : "CORROMPUE");
+    printf("Zone du thread principal : %s\n", mem_current() == mem ? "toujours choisie" : "REMPLACEE");
+    mem_free(ptr);
+    mem_show(&print);
+
+    free(mem);
+    free(mem1);
+    free(mem2);
+    printf("\nMémoire libérée. Test 22 terminé.\n\n");
+}
 
 int main() {
 	printf("Taille de la structure allocator_header : %ld\n", SIZE_OF_STRUCT_ALLOCATOR_HEADER);
@@ -265,6 +660,21 @@ int main() {
     test_07();
     test_08();
     test_09();
+    test_10();
+    test_11();
+    test_12();
+    test_13();
+    test_14();
+#ifdef MEM_STATS
+    test_15();
+#endif
+    test_16();
+    test_17();
+    test_18();
+    test_19();
+    test_20();
+    test_21();
+    test_22();
 
     return 0;
 }